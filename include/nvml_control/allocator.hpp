@@ -1,15 +1,50 @@
 #pragma once
 
 #include "nvml_control/instance.hpp"
+#include "nvml_control/sampler.hpp"
+#include "nvml_control/timer_wheel.hpp"
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace nvml {
 
+/**
+ * @brief A resource-shaped allocation request. The allocator grants the
+ * smallest GPU Instance/Compute Instance profile pair satisfying every field.
+ */
+struct Request {
+    /// minimum GPU memory in MiB
+    unsigned long long memory_mb{0};
+    /// minimum fraction of the GPU's streaming multiprocessors, in [0, 1]
+    double sm_fraction{0.0};
+    /// minimum number of media engines, only available on some profiles
+    unsigned int decoder_count{0};
+    unsigned int encoder_count{0};
+    unsigned int jpeg_count{0};
+    unsigned int ofa_count{0};
+};
+
+/**
+ * @brief A ComputeInstance held by its Allocator on behalf of a client. The
+ * lease expires, and its instance is freed, unless the client renews it with
+ * Allocator::heartbeat within its TTL.
+ */
+struct Lease {
+    std::uint64_t id{0};
+    std::string cuda_visible_devices;
+    Shape shape;
+};
+
 /**
  * @brief the Allocator creates Compute instances with isolated memory and
  * compute resources.
@@ -18,7 +53,90 @@ class Allocator {
 protected:
     GPU &device_;
     std::mutex mutex_;
-    std::condition_variable cv_;
+    std::condition_variable cv_;  // notified by free
+    std::uint64_t n_frees_{0};    // guarded by mutex_
+    std::set<nvmlComputeInstance_t> live_;  // guarded by mutex_
+    std::unique_ptr<Sampler> sampler_;      // guarded by mutex_
+
+    struct LeaseRecord {
+        ComputeInstance instance;
+        std::chrono::steady_clock::duration ttl;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point not_after;
+    };
+    std::mutex lease_mutex_;
+    std::condition_variable lease_cv_;
+    bool lease_stop_{false};
+    /// the number of expired instances the reaper has yet to free
+    std::size_t reclaiming_{0};
+    std::uint64_t next_lease_id_{1};
+    std::unordered_map<std::uint64_t, LeaseRecord> leases_;
+    TimerWheel lease_wheel_;
+    std::chrono::steady_clock::time_point lease_epoch_;
+    std::thread reaper_;  // started by the first lease
+
+    /// Expires leases whose deadline has passed, one wheel tick at a time
+    void reap() noexcept;
+
+    /// Returns the first wheel tick at or after time, or 0 if time is before
+    /// the wheel started
+    std::uint64_t
+    lease_tick(std::chrono::steady_clock::time_point time) const noexcept;
+
+    /**
+     * @brief Stops the reaper thread and frees every outstanding lease.
+     * Derived classes must call this in their destructor, while free() and
+     * the resources their instances depend on are still available.
+     */
+    void release_leases() noexcept;
+
+    /**
+     * @brief Records a newly allocated instance so it can be sampled. The
+     * instance is not sampled if the sampler cannot find its MIG device. The
+     * caller must hold mutex_.
+     */
+    void track(const ComputeInstance &instance) noexcept;
+
+    /// Adds instance to sampler, unless it cannot be sampled
+    static void try_sample(Sampler &sampler,
+                           nvmlComputeInstance_t instance) noexcept;
+
+    /**
+     * @brief Forgets an instance that is about to be freed and counts the
+     * free for allocate_for. The caller must hold mutex_ and notify cv_.
+     */
+    void untrack(const ComputeInstance &instance) noexcept;
+
+    /**
+     * @brief Returns the number of streaming multiprocessors needed to satisfy
+     * request.
+     * @throws invalid_argument if request.sm_fraction is out of range
+     */
+    unsigned int required_multiprocessors(const Request &request) const;
+
+    /**
+     * @brief Returns true if a GPU Instance of profile satisfies the memory
+     * and engine requirements of request and has at least multiprocessors.
+     */
+    static bool fits(const nvmlGpuInstanceProfileInfo_t &profile,
+                     const Request &request,
+                     unsigned int multiprocessors) noexcept;
+
+    /**
+     * @brief Returns the GPU Instance profiles of the device that satisfy
+     * request, smallest first.
+     * @throws invalid_argument if no profile satisfies request
+     */
+    std::vector<nvmlGpuInstanceProfileInfo_t>
+    fitting_gpu_instance_profiles(const Request &request) const;
+
+    /**
+     * @brief Returns the Compute Instance profiles of gpu_instance with at
+     * least multiprocessors, smallest first.
+     */
+    static std::vector<nvmlComputeInstanceProfileInfo_t>
+    fitting_compute_instance_profiles(const GPUInstance &gpu_instance,
+                                      unsigned int multiprocessors);
 
 public:
     /**
@@ -31,14 +149,33 @@ public:
 
     virtual ~Allocator() = default;
     /**
-     * @brief Allocate a ComputeInstance on the GPU.
-     * This operation blocks until the placement can be satisfied
+     * @brief Allocate a ComputeInstance on the GPU. Does not wait for
+     * capacity; see allocate_for.
      * @param n_slices the number of slices to allocate
      * @returns The allocated ComputeInstance
      * @throws runtime_error if unable to allocate
      */
     virtual ComputeInstance allocate(unsigned short n_slices) = 0;
 
+    /**
+     * @brief Allocate the smallest ComputeInstance satisfying request. The
+     * granted resources are reported by ComputeInstance::get_shape().
+     * @param request the minimum resources to allocate
+     * @returns The allocated ComputeInstance
+     * @throws invalid_argument if no profile on the GPU can satisfy request
+     * @throws runtime_error if unable to allocate
+     */
+    virtual ComputeInstance allocate(const Request &request) = 0;
+
+    /**
+     * @brief Allocate n_slices, waiting up to timeout for instances to be
+     * freed, or for their leases to expire, if the GPU is full.
+     * @throws invalid_argument if n_slices is invalid
+     * @throws runtime_error if unable to allocate within timeout
+     */
+    ComputeInstance allocate_for(unsigned short n_slices,
+                                 std::chrono::milliseconds timeout);
+
     /**
      * @brief Returns the number of remaining allocations for n_slices
      * @param n_slices the size of the allocation unit
@@ -49,11 +186,62 @@ public:
      * @brief Free a ComputeInstance and make its range of slices available for
      * future allocations. This operation frees the GPU Instance and Compute
      * Instance of the ComputeInstance and notifies any waiters blocked in
-     * allocate.
+     * allocate_for.
      * @param instance An instance to free. Should not be in use.
      * @throws runtime_error if unable to free the instance
      */
     virtual void free(ComputeInstance &&instance) = 0;
+
+    /**
+     * @brief Hands instance over to the Allocator as a lease. If the lease is
+     * not renewed with heartbeat within ttl, a background thread frees its
+     * instance and notifies any waiters blocked in allocate_for.
+     * @param instance an instance returned by allocate on this Allocator
+     * @param ttl the time the lease survives without a heartbeat
+     * @param not_after the lease expires at this time even if renewed
+     * @returns the Lease, which identifies instance in heartbeat and release
+     */
+    Lease lease(ComputeInstance &&instance, std::chrono::milliseconds ttl,
+                std::chrono::steady_clock::time_point not_after =
+                    std::chrono::steady_clock::time_point::max());
+
+    /**
+     * @brief Renews lease for another TTL, measured from now, but not past
+     * the lease's not_after time.
+     * @returns false if the lease has already expired or been released
+     */
+    bool heartbeat(const Lease &lease);
+
+    /**
+     * @brief Frees the instance of lease before it expires.
+     * @returns false if the lease has already expired or been released. An
+     * expired instance has been freed by the time false is returned.
+     * @throws runtime_error if unable to free the instance
+     */
+    bool release(const Lease &lease);
+
+    /// Returns the GPU device this Allocator allocates on
+    const GPU &device() const noexcept { return device_; }
+
+    /**
+     * @brief Starts a background thread sampling the memory usage and
+     * activity of every live ComputeInstance of this Allocator. Restarts the
+     * sampler, discarding its history, if it is already running. Instances
+     * that cannot be sampled, here or when allocated later, are skipped.
+     * @param period the time between samples
+     */
+    void start_sampler(std::chrono::milliseconds period);
+
+    /**
+     * @brief Stops the sampler thread and discards its history
+     */
+    void stop_sampler() noexcept;
+
+    /**
+     * @brief Returns the running Sampler, or NULL if start_sampler has not
+     * been called. The Sampler is destroyed by stop_sampler.
+     */
+    const Sampler *sampler() const noexcept { return sampler_.get(); }
 };
 
 class SharedGIAllocator : public Allocator {
@@ -62,7 +250,9 @@ private:
 
 public:
     SharedGIAllocator(GPU &device);
+    ~SharedGIAllocator() noexcept override;
     ComputeInstance allocate(unsigned short n_slices) override;
+    ComputeInstance allocate(const Request &request) override;
     unsigned int remaining(unsigned short n_slices) const noexcept override;
     void free(ComputeInstance &&instance) override;
 };
@@ -70,9 +260,67 @@ public:
 class IsolatedGIAllocator : public Allocator {
 public:
     using Allocator::Allocator;
+    ~IsolatedGIAllocator() noexcept override;
     ComputeInstance allocate(unsigned short n_slices) override;
+    ComputeInstance allocate(const Request &request) override;
+
+    /**
+     * @brief Allocate n_slices in a GPU Instance at placement
+     * @param placement one of device().gpu_instance_placements(n_slices)
+     * @throws invalid_argument if n_slices is invalid
+     * @throws runtime_error if the placement is occupied or invalid
+     */
+    ComputeInstance allocate(unsigned short n_slices,
+                             const nvmlGpuInstancePlacement_t &placement);
     unsigned int remaining(unsigned short n_slices) const noexcept override;
     void free(ComputeInstance &&instance) override;
 };
 
+/**
+ * @brief The GangAllocator places multi-instance jobs on a set of GPUs that
+ * are close to each other, allocating one ComputeInstance per GPU.
+ */
+class GangAllocator {
+private:
+    std::vector<Allocator *> allocators_;
+    /// GPU::distance between the GPUs of each pair of allocators_
+    std::vector<std::vector<unsigned int>> distances_;
+    std::size_t n_gpus_;  // distinct GPUs among allocators_
+    std::mutex mutex_;
+    /// the allocator of each instance allocated and not yet freed
+    std::map<nvmlComputeInstance_t, Allocator *> owners_;  // guarded by mutex_
+
+    /// Sums the pairwise distances between the GPUs of allocators_ in gang
+    unsigned int gang_distance(const std::vector<std::size_t> &gang) const;
+
+public:
+    /**
+     * @brief Constructs a GangAllocator over allocators. Several allocators
+     * may share a GPU; a gang uses at most one of them.
+     * The allocators must outlive the GangAllocator.
+     */
+    explicit GangAllocator(std::vector<Allocator *> allocators);
+
+    /**
+     * @brief Allocate n_slices on each of n_gpus distinct GPUs. Among the
+     * GPUs with remaining capacity, picks the set with the smallest sum of
+     * pairwise GPU::distance, so that NVLink and shared PCIe switches are
+     * preferred.
+     * @returns the allocated instances, one per GPU
+     * @throws invalid_argument if n_gpus is 0 or exceeds the number of GPUs
+     * @throws runtime_error if unable to allocate
+     */
+    std::vector<ComputeInstance> allocate(std::size_t n_gpus,
+                                          unsigned short n_slices);
+
+    /**
+     * @brief Free instances allocated by allocate, each through the
+     * Allocator it was allocated from
+     * @throws invalid_argument if an instance was not allocated by this
+     * GangAllocator, in which case no instance is freed
+     * @throws runtime_error if unable to free an instance
+     */
+    void free(std::vector<ComputeInstance> &&instances);
+};
+
 }  // namespace nvml
@@ -2,28 +2,60 @@
 
 #include <memory>
 #include <nvml.h>
+#include <sched.h>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace nvml {
 
+/**
+ * @brief A reference to the NVML library. NVML is initialized when the first
+ * reference is created and shut down when the last one is destroyed, so that
+ * programs which never use a GPU do not pay for initialization. Every GPU,
+ * GPUInstance and ComputeInstance holds a reference, so that NVML outlives
+ * every handle.
+ */
+class NVMLControl {
+public:
+    /**
+     * @brief Adds a reference, initializing NVML if there is none.
+     * @throws runtime_error if NVML fails to initialize
+     */
+    NVMLControl();
+    NVMLControl(const NVMLControl &rhs) noexcept;
+    NVMLControl &operator=(const NVMLControl &rhs) noexcept = default;
+    ~NVMLControl();
+};
+
 /**
  * @brief A class encapsulating a GPU device representation
  */
 class GPU {
 private:
+    NVMLControl nvml_;  // first, so that NVML outlives the members below
     nvmlDevice_t device_;
-    friend class GPUInstance;  // for access to device_
+    friend class GPUInstance;  // for access to nvml_ and device_
+    std::vector<nvmlGpuInstanceProfileInfo_t> gpu_instance_profiles_;
+    cpu_set_t cpu_affinity_;
+    int numa_node_{-1};
+
 public:
+    /// The distance between two GPUs connected by NVLink, see distance()
+    static constexpr unsigned int NVLINK_DISTANCE = 5;
+
     /// The GPU index passed to the constructor
     const int device_id_;
 
     /**
-     * @brief Constructor
+     * @brief Constructor. The first GPU constructed discovers every GPU in
+     * parallel; the results are cached until NVML is shut down.
      * @param device The GPU device index number, such as the number passed to
      * CUDA_VISIBLE_DEVICES
+     * @throws runtime_error if NVML fails to initialize or the device cannot
+     * be queried
      */
-    GPU(int device) noexcept;
+    GPU(int device);
 
     /**
      * @brief Gets the number of concurrent GPU Instances
@@ -33,6 +65,55 @@ public:
     unsigned int
     remaining_gpu_instance_capacity(unsigned short n_slices) const noexcept;
 
+    /**
+     * @brief Gets the number of concurrent GPU Instances of profile that can
+     * be allocated
+     * @param profile one of the profiles from gpu_instance_profiles()
+     */
+    unsigned int remaining_gpu_instance_capacity(
+        const nvmlGpuInstanceProfileInfo_t &profile) const noexcept;
+
+    /**
+     * @brief Returns every placement, in memory slices, that a GPU Instance of
+     * n_slices may occupy on this GPU
+     * @throws invalid_argument if n_slices is invalid.
+     * @throws runtime_error if the placements cannot be queried
+     */
+    std::vector<nvmlGpuInstancePlacement_t>
+    gpu_instance_placements(unsigned short n_slices) const;
+
+    /**
+     * @brief Returns the GPU Instance profiles supported by this GPU, as
+     * reported by NVML when the GPU was constructed.
+     */
+    const std::vector<nvmlGpuInstanceProfileInfo_t> &
+    gpu_instance_profiles() const noexcept {
+        return gpu_instance_profiles_;
+    }
+
+    /**
+     * @brief Returns the number of streaming multiprocessors available to
+     * GPU Instances, i.e. those of the largest GPU Instance profile.
+     */
+    unsigned int multiprocessor_count() const noexcept;
+
+    /**
+     * @brief Returns the CPUs closest to this GPU
+     */
+    const cpu_set_t &cpu_affinity() const noexcept { return cpu_affinity_; }
+
+    /**
+     * @brief Returns the NUMA node closest to this GPU, or -1 if unknown
+     */
+    int numa_node() const noexcept { return numa_node_; }
+
+    /**
+     * @brief Returns the interconnect distance to other: 0 for the same GPU,
+     * NVLINK_DISTANCE if the GPUs are connected by NVLink, and otherwise the
+     * nvmlGpuTopologyLevel_t of their closest common PCIe ancestor.
+     */
+    unsigned int distance(const GPU &other) const noexcept;
+
 private:
     /**
      * @brief Returns the GPU Instance profile ID corresponding to the n_slices.
@@ -55,14 +136,29 @@ private:
                                    // look_up_compute_instance_profile_id
 };
 
+/**
+ * @brief A GPU Instance on a GPU. It may be destroyed after its GPU, but any
+ * other use, including creating a ComputeInstance on it, needs the GPU.
+ */
 class GPUInstance {
 private:
+    // first, so that NVML outlives the members below; only set if valid_
+    std::unique_ptr<NVMLControl> nvml_;
+    friend class ComputeInstance;  // for access to nvml_
     bool valid_{false};
     friend class Allocator;  // for access to valid_
     GPU const *gpu_;
     friend class ComputeInstance;  // for access to gpu_
     nvmlGpuInstance_t instance_;
     friend class ComputeInstance;  // for access to instance_;
+    nvmlGpuInstanceProfileInfo_t profile_{};
+
+    /**
+     * @brief Returns the Compute Instance profile corresponding to n_slices.
+     * @throws invalid_argument if n_slices is invalid.
+     */
+    nvmlComputeInstanceProfileInfo_t
+    compute_instance_profile(unsigned short n_slices) const;
 
 public:
     /**
@@ -71,6 +167,24 @@ public:
      * @param size occupying this many slices
      */
     GPUInstance(GPU &gpu, unsigned short size);
+
+    /**
+     * @brief Create a GPUInstance at a fixed placement
+     * @param gpu on this GPU device
+     * @param size occupying this many slices
+     * @param placement at this placement, one of
+     * gpu.gpu_instance_placements(size)
+     * @throws runtime_error if the placement is occupied or invalid
+     */
+    GPUInstance(GPU &gpu, unsigned short size,
+                const nvmlGpuInstancePlacement_t &placement);
+
+    /**
+     * @brief Create a GPUInstance
+     * @param gpu on this GPU device
+     * @param profile with this profile, one of gpu.gpu_instance_profiles()
+     */
+    GPUInstance(GPU &gpu, const nvmlGpuInstanceProfileInfo_t &profile);
     GPUInstance(GPUInstance &&rhs) noexcept;
     GPUInstance() noexcept : valid_(false) {}
     ~GPUInstance() noexcept;
@@ -85,18 +199,67 @@ public:
     unsigned int
     remaining_compute_instance_capacity(unsigned short n_slices) const noexcept;
 
+    /**
+     * @brief Gets the number of remaining Compute Instances available of
+     * profile on this GPU Instance.
+     * @param profile one of the profiles from compute_instance_profiles()
+     */
+    unsigned int remaining_compute_instance_capacity(
+        const nvmlComputeInstanceProfileInfo_t &profile) const noexcept;
+
+    /**
+     * @brief Returns the Compute Instance profiles supported by this GPU
+     * Instance, including those with fewer slices than the GPU Instance.
+     */
+    std::vector<nvmlComputeInstanceProfileInfo_t>
+    compute_instance_profiles() const;
+
     nvmlGpuInstancePlacement_t get_placement() const noexcept;
+    const nvmlGpuInstanceProfileInfo_t &get_profile() const noexcept {
+        return profile_;
+    }
     bool is_valid() const noexcept { return valid_; }
 };
 
+/**
+ * @brief The resources granted to a ComputeInstance
+ */
+struct Shape {
+    unsigned int gpu_instance_profile_id{0};
+    unsigned int compute_instance_profile_id{0};
+    unsigned int gpu_instance_slices{0};
+    unsigned int compute_instance_slices{0};
+    /// GPU memory of the GPU Instance, shared by all its Compute Instances
+    unsigned long long memory_mb{0};
+    unsigned int multiprocessor_count{0};
+    /// engines of the GPU Instance, shared by all its Compute Instances
+    unsigned int copy_engine_count{0};
+    unsigned int decoder_count{0};
+    unsigned int encoder_count{0};
+    unsigned int jpeg_count{0};
+    unsigned int ofa_count{0};
+};
+
 class ComputeInstance {
 private:
+    // first, so that NVML outlives managed_ and instance_; only set if valid_
+    std::unique_ptr<NVMLControl> nvml_;
     bool valid_{false};
     nvmlComputeInstance_t instance_;
     friend class Allocator;  // for access to instance_ in
                              // allocated_slice_start_ map
+    friend class Sampler;    // for access to instance_
+    friend class GangAllocator;  // for access to instance_
     GPUInstance managed_;    // only set if this Compute Instance manges its own
                              // GPU Instance
+    Shape shape_;
+    // copied from the GPU, which may be destroyed first
+    int device_id_{-1};
+    cpu_set_t cpu_affinity_{};
+    int numa_node_{-1};
+
+    void create(const GPUInstance &gpu_instance,
+                const nvmlComputeInstanceProfileInfo_t &profile);
 
 public:
     /**
@@ -115,21 +278,49 @@ public:
      * This constructor refers to an existing GPU instance
      */
     ComputeInstance(GPUInstance &gpu_instance, unsigned int n_slices);
+
+    /**
+     * @brief Create a ComputeInstance
+     * @param gpu on this GPUInstance
+     * @param profile with this profile, one of
+     * gpu_instance.compute_instance_profiles()
+     * This constructor takes ownership of a GPU instance and manages its
+     * lifetime.
+     */
+    ComputeInstance(GPUInstance &&gpu_instance,
+                    const nvmlComputeInstanceProfileInfo_t &profile);
+
+    /**
+     * @brief Create a ComputeInstance
+     * @param gpu on this GPUInstance
+     * @param profile with this profile, one of
+     * gpu_instance.compute_instance_profiles()
+     * This constructor refers to an existing GPU instance
+     */
+    ComputeInstance(GPUInstance &gpu_instance,
+                    const nvmlComputeInstanceProfileInfo_t &profile);
     ComputeInstance(ComputeInstance &&rhs) noexcept;
     ComputeInstance() noexcept : valid_(false) {}
     ~ComputeInstance() noexcept;
     ComputeInstance &operator=(ComputeInstance &&rhs) noexcept;
     std::string get_cuda_visible_devices_string() const noexcept;
-    bool is_valid() const noexcept { return valid_; }
-};
+    const Shape &get_shape() const noexcept { return shape_; }
 
-class NVMLControl {
-private:
-    friend class ComputeInstance;
+    /// Returns the index of the GPU of this instance, or -1 if not valid
+    int get_device_id() const noexcept { return device_id_; }
 
-public:
-    NVMLControl();
-    ~NVMLControl();
+    /**
+     * @brief Returns the CPUs closest to the GPU of this instance, or an
+     * empty set if not valid
+     */
+    cpu_set_t get_cpu_affinity() const noexcept { return cpu_affinity_; }
+
+    /**
+     * @brief Returns the NUMA node closest to the GPU of this instance, or -1
+     * if unknown or not valid
+     */
+    int get_numa_node() const noexcept { return numa_node_; }
+    bool is_valid() const noexcept { return valid_; }
 };
 
 }  // namespace nvml
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+
+namespace nvml {
+
+/**
+ * @brief A set of half-open intervals [start, end) with values, supporting
+ * insertion, removal and overlap queries in O(log n) expected time plus the
+ * number of reported intervals. Implemented as a treap ordered by (start,
+ * value) and augmented with the maximum end of each subtree.
+ * @tparam Key an ordered interval endpoint type
+ * @tparam Value an ordered value type; (start, value) pairs must be unique
+ */
+template <typename Key, typename Value>
+class IntervalTree {
+private:
+    struct Node {
+        Key start;
+        Key end;
+        Value value;
+        std::uint32_t priority;
+        Key max_end;
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+    };
+    using NodePtr = std::unique_ptr<Node>;
+
+    NodePtr root_;
+    std::size_t size_{0};
+    std::minstd_rand random_;
+
+    static bool less(const Key &start, const Value &value, const Node &node) {
+        return start < node.start ||
+               (!(node.start < start) && value < node.value);
+    }
+
+    static void update(Node &node) {
+        node.max_end = node.end;
+        if (node.left && node.max_end < node.left->max_end) {
+            node.max_end = node.left->max_end;
+        }
+        if (node.right && node.max_end < node.right->max_end) {
+            node.max_end = node.right->max_end;
+        }
+    }
+
+    static void rotate_right(NodePtr &node) {
+        NodePtr left = std::move(node->left);
+        node->left = std::move(left->right);
+        update(*node);
+        left->right = std::move(node);
+        update(*left);
+        node = std::move(left);
+    }
+
+    static void rotate_left(NodePtr &node) {
+        NodePtr right = std::move(node->right);
+        node->right = std::move(right->left);
+        update(*node);
+        right->left = std::move(node);
+        update(*right);
+        node = std::move(right);
+    }
+
+    static void insert(NodePtr &node, NodePtr &&inserted) {
+        if (!node) {
+            node = std::move(inserted);
+            return;
+        }
+        if (less(inserted->start, inserted->value, *node)) {
+            insert(node->left, std::move(inserted));
+            if (node->left->priority > node->priority) {
+                rotate_right(node);
+                return;
+            }
+        } else {
+            insert(node->right, std::move(inserted));
+            if (node->right->priority > node->priority) {
+                rotate_left(node);
+                return;
+            }
+        }
+        update(*node);
+    }
+
+    static bool erase(NodePtr &node, const Key &start, const Value &value) {
+        if (!node) {
+            return false;
+        }
+        bool erased;
+        if (less(start, value, *node)) {
+            erased = erase(node->left, start, value);
+        } else if (node->start < start || node->value < value) {
+            erased = erase(node->right, start, value);
+        } else {
+            // rotate the node down until it has at most one child
+            if (!node->left) {
+                node = std::move(node->right);
+                return true;
+            }
+            if (!node->right) {
+                node = std::move(node->left);
+                return true;
+            }
+            if (node->left->priority > node->right->priority) {
+                rotate_right(node);
+                erased = erase(node->right, start, value);
+            } else {
+                rotate_left(node);
+                erased = erase(node->left, start, value);
+            }
+        }
+        update(*node);
+        return erased;
+    }
+
+    template <typename F>
+    static void overlapping(const NodePtr &node, const Key &start,
+                            const Key &end, F &f) {
+        if (!node || !(start < node->max_end)) {
+            // every interval in this subtree ends at or before start
+            return;
+        }
+        overlapping(node->left, start, end, f);
+        if (!(node->start < end)) {
+            // this interval and those to its right start at or after end
+            return;
+        }
+        if (start < node->end) {
+            f(node->start, node->end, node->value);
+        }
+        overlapping(node->right, start, end, f);
+    }
+
+public:
+    IntervalTree() = default;
+    IntervalTree(IntervalTree &&) noexcept = default;
+    IntervalTree &operator=(IntervalTree &&) noexcept = default;
+
+    /**
+     * @brief Inserts [start, end) with value
+     */
+    void insert(const Key &start, const Key &end, const Value &value) {
+        NodePtr node(new Node{start, end, value,
+                              static_cast<std::uint32_t>(random_()), end,
+                              nullptr, nullptr});
+        insert(root_, std::move(node));
+        size_++;
+    }
+
+    /**
+     * @brief Removes the interval starting at start with value
+     * @returns false if there is no such interval
+     */
+    bool erase(const Key &start, const Value &value) {
+        if (!erase(root_, start, value)) {
+            return false;
+        }
+        size_--;
+        return true;
+    }
+
+    /**
+     * @brief Calls f(start, end, value) for every interval overlapping
+     * [start, end), in order of start.
+     */
+    template <typename F>
+    void overlapping(const Key &start, const Key &end, F f) const {
+        overlapping(root_, start, end, f);
+    }
+
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+};
+
+}  // namespace nvml
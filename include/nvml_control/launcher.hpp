@@ -0,0 +1,123 @@
+#pragma once
+
+#include "nvml_control/allocator.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace nvml {
+
+/**
+ * @brief A process launched on a ComputeInstance by a Launcher
+ */
+struct Job {
+    /// identifies the job within its Launcher; unlike pid, never reused
+    std::uint64_t id{0};
+    pid_t pid{-1};
+    std::string cuda_visible_devices;
+    Shape shape;
+    /// time spent in Allocator::allocate
+    std::chrono::steady_clock::duration allocate_latency{};
+    /// time from the start of allocate until the command was executed
+    std::chrono::steady_clock::duration allocate_to_exec_latency{};
+};
+
+/**
+ * @brief The Launcher allocates a ComputeInstance, spawns a command with
+ * CUDA_VISIBLE_DEVICES set to it, and frees the instance as soon as the
+ * command exits. A single thread monitors every child through its pidfd.
+ */
+class Launcher {
+private:
+    struct Child {
+        ComputeInstance instance;
+        int pidfd;
+        bool detached;  // its status is discarded on exit
+    };
+
+    Allocator &allocator_;
+    int epoll_fd_;
+    int event_fd_;  // wakes the monitor thread on destruction
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::uint64_t next_job_id_{1};                      // guarded by mutex_
+    std::unordered_map<std::uint64_t, Child> children_;  // guarded by mutex_
+    /// the status of exited jobs until waited for or detached
+    std::unordered_map<std::uint64_t, int> exited_;  // guarded by mutex_
+    bool stop_{false};
+    std::thread monitor_;
+
+    Job spawn(ComputeInstance &&instance,
+              std::chrono::steady_clock::time_point start,
+              const std::vector<std::string> &argv);
+    /// Handles a child spawned without a pidfd that pidfd_open failed on
+    Job unpinned(ComputeInstance &&instance, Job &&job, int error);
+    void monitor() noexcept;
+
+public:
+    /// The status reported by wait when the child was reaped elsewhere
+    static constexpr int UNKNOWN_STATUS = -1;
+
+    /**
+     * @brief Constructs a Launcher allocating from allocator
+     * @throws system_error if unable to create the monitor's file descriptors
+     */
+    explicit Launcher(Allocator &allocator);
+
+    /**
+     * @brief Waits for every running child to exit and frees its instance
+     */
+    ~Launcher() noexcept;
+    Launcher(const Launcher &) = delete;
+    Launcher &operator=(const Launcher &) = delete;
+
+    /**
+     * @brief Allocates n_slices and spawns argv on them. argv[0] is looked up
+     * in PATH; no shell is involved.
+     * @returns the running Job
+     * @throws invalid_argument if argv is empty
+     * @throws runtime_error if unable to allocate
+     * @throws system_error if unable to spawn or monitor argv, after freeing
+     * the instance
+     */
+    Job launch(unsigned short n_slices, const std::vector<std::string> &argv);
+
+    /**
+     * @brief Allocates the smallest instance satisfying request and spawns
+     * argv on it.
+     * @see launch(unsigned short, const std::vector<std::string> &)
+     */
+    Job launch(const Request &request, const std::vector<std::string> &argv);
+
+    /**
+     * @brief Blocks until job exits. Its instance has been freed on return.
+     * The exit status of a job is retained until it is waited for or
+     * detached.
+     * @returns the wait status of job, in the format of waitpid, or
+     * UNKNOWN_STATUS if the child was reaped outside of this Launcher, e.g.
+     * because SIGCHLD is ignored
+     * @throws invalid_argument if job is not a child of this Launcher or was
+     * already waited for or detached
+     */
+    int wait(const Job &job);
+
+    /**
+     * @brief Discards the exit status of job, which then cannot be waited
+     * for. Its instance is still freed when it exits.
+     * @returns false if job is not a child of this Launcher or was already
+     * waited for or detached
+     */
+    bool detach(const Job &job);
+
+    /// Returns the number of children that have not exited
+    std::size_t running();
+};
+
+}  // namespace nvml
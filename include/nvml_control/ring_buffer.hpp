@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace nvml {
+
+/**
+ * @brief A fixed-size, lock-free ring buffer with a single producer and any
+ * number of consumers. The producer never waits for consumers: it overwrites
+ * the oldest value, and consumers discard values that were overwritten while
+ * they were being read.
+ * @tparam T a trivially copyable value type
+ * @tparam N the number of values retained
+ */
+template <typename T, std::size_t N>
+class RingBuffer {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "RingBuffer values must be trivially copyable");
+    static_assert(N > 0, "RingBuffer must have capacity");
+
+private:
+    static constexpr std::size_t WORDS =
+        (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    // Each slot is a seqlock: the sequence is odd while the producer writes
+    // the slot and 2 * (index + 1) once value index is complete.
+    struct Slot {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<std::uint64_t> words[WORDS];
+    };
+
+    Slot slots_[N];
+    std::atomic<std::uint64_t> head_{0};  // number of values ever pushed
+
+    bool read(std::uint64_t index, T &value) const noexcept {
+        const Slot &slot = slots_[index % N];
+        const std::uint64_t before =
+            slot.sequence.load(std::memory_order_acquire);
+        if (before != 2 * (index + 1)) {
+            // overwritten by a newer value, or being overwritten
+            return false;
+        }
+        std::uint64_t words[WORDS];
+        for (std::size_t i = 0; i < WORDS; i++) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+        std::memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+public:
+    static constexpr std::size_t capacity() noexcept { return N; }
+
+    /**
+     * @brief Appends value, overwriting the oldest value if full. Must only be
+     * called from one thread at a time.
+     */
+    void push(const T &value) noexcept {
+        const std::uint64_t index = head_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[index % N];
+        std::uint64_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < WORDS; i++) {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.sequence.store(2 * (index + 1), std::memory_order_release);
+        head_.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Returns up to n of the most recent values, oldest first. Safe to
+     * call concurrently with push().
+     */
+    std::vector<T> recent(std::size_t n = N) const {
+        const std::uint64_t head = head_.load(std::memory_order_acquire);
+        const std::uint64_t count =
+            std::min<std::uint64_t>(std::min<std::uint64_t>(n, N), head);
+        std::vector<T> ret;
+        ret.reserve(count);
+        for (std::uint64_t index = head - count; index < head; index++) {
+            T value;
+            if (read(index, value)) {
+                ret.push_back(value);
+            }
+        }
+        return ret;
+    }
+
+    /// Returns the number of values ever pushed
+    std::uint64_t size() const noexcept {
+        return head_.load(std::memory_order_acquire);
+    }
+};
+
+}  // namespace nvml
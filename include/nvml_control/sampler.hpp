@@ -0,0 +1,96 @@
+#pragma once
+
+#include "nvml_control/instance.hpp"
+#include "nvml_control/ring_buffer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nvml {
+
+/**
+ * @brief A single utilization reading of a ComputeInstance's MIG device
+ */
+struct Sample {
+    std::chrono::steady_clock::time_point time;
+    unsigned long long memory_used{0};   // bytes
+    unsigned long long memory_total{0};  // bytes
+    unsigned int process_count{0};       // running compute processes
+};
+
+/**
+ * @brief Utilization of a ComputeInstance aggregated over a window of samples
+ */
+struct Utilization {
+    std::size_t n_samples{0};
+    unsigned long long memory_total{0};
+    unsigned long long mean_memory_used{0};
+    unsigned long long max_memory_used{0};
+    /// fraction of samples with at least one running compute process
+    double active_fraction{0.0};
+};
+
+/**
+ * @brief The Sampler periodically reads the memory usage and activity of
+ * every live ComputeInstance of an Allocator on a background thread. Queries
+ * read lock-free ring buffers and never block the sampler thread.
+ */
+class Sampler {
+public:
+    /// the number of samples retained per ComputeInstance
+    static constexpr std::size_t HISTORY = 512;
+
+    /**
+     * @brief Starts the sampler thread
+     * @param period the time between samples
+     */
+    explicit Sampler(std::chrono::milliseconds period);
+    ~Sampler() noexcept;
+    Sampler(const Sampler &) = delete;
+    Sampler &operator=(const Sampler &) = delete;
+
+    /**
+     * @brief Returns up to n of the most recent samples of instance, oldest
+     * first. Returns no samples if instance is not being sampled.
+     */
+    std::vector<Sample> recent(const ComputeInstance &instance,
+                               std::size_t n = HISTORY) const;
+
+    /**
+     * @brief Aggregates the samples of instance taken within window of now.
+     */
+    Utilization aggregate(const ComputeInstance &instance,
+                          std::chrono::steady_clock::duration window) const;
+
+private:
+    friend class Allocator;  // for access to add and remove
+
+    struct Series {
+        nvmlDevice_t mig_device;
+        RingBuffer<Sample, HISTORY> samples;
+    };
+
+    /**
+     * @brief Starts sampling a Compute Instance. instance must be alive.
+     * @throws runtime_error if its MIG device cannot be found
+     */
+    void add(nvmlComputeInstance_t instance);
+    void remove(nvmlComputeInstance_t instance) noexcept;
+    std::shared_ptr<const Series>
+    find(nvmlComputeInstance_t instance) const noexcept;
+    void run() noexcept;
+
+    const std::chrono::milliseconds period_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_{false};
+    std::map<nvmlComputeInstance_t, std::shared_ptr<Series>> series_;
+    std::thread thread_;
+};
+
+}  // namespace nvml
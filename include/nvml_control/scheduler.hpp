@@ -0,0 +1,133 @@
+#pragma once
+
+#include "nvml_control/allocator.hpp"
+#include "nvml_control/interval_tree.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace nvml {
+
+/**
+ * @brief The Scheduler books future windows of slices on an Allocator's GPU.
+ * A reservation holds instances from a start time for a duration; backfill
+ * allocations run now for a declared hold time and are admitted only if every
+ * booking they overlap can still be placed alongside them. All bookings are
+ * leases that expire at the end of their window, so a reservation finds its
+ * slices free when it starts.
+ *
+ * Each booked instance is assigned a GPU Instance placement when it is
+ * admitted, and is created at that placement, so bookings that do not
+ * overlap in time or in slices cannot fragment the GPU for each other. The
+ * Scheduler must be the only client of its Allocator.
+ */
+class Scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructs a Scheduler allocating from allocator, whose
+     * instances each own a GPU Instance that can be placed
+     * @throws runtime_error if the GPU Instance placements cannot be queried
+     */
+    explicit Scheduler(IsolatedGIAllocator &allocator);
+
+    /**
+     * @brief Reserves n_instances instances of n_slices each from start for
+     * duration.
+     * @returns the reservation id, used by claim and cancel
+     * @throws invalid_argument if the arguments are invalid
+     * @throws runtime_error if the reservation cannot be placed alongside
+     * the bookings it overlaps
+     */
+    std::uint64_t reserve(unsigned short n_instances, unsigned short n_slices,
+                          clock::time_point start, clock::duration duration);
+
+    /**
+     * @brief Blocks until the reservation starts, then allocates its
+     * instances. Backfill allocations that outlived their hold time are freed
+     * first. Release each lease with release.
+     * @returns one lease per instance, expiring at the end of the reservation
+     * @throws invalid_argument if reservation is unknown or already claimed
+     * @throws runtime_error if unable to allocate, or if the reservation has
+     * already ended
+     */
+    std::vector<Lease> claim(std::uint64_t reservation);
+
+    /**
+     * @brief Cancels a reservation, releasing its leases if claimed
+     * @returns false if the reservation is unknown
+     */
+    bool cancel(std::uint64_t reservation);
+
+    /**
+     * @brief Allocates n_slices now, for at most hold. The allocation is
+     * admitted only if it does not prevent any reservation from being placed,
+     * and it is freed when hold has passed even if renewed by heartbeat.
+     * @returns the lease of the instance
+     * @throws invalid_argument if n_slices is invalid or hold is not positive
+     * @throws runtime_error if the allocation conflicts with a booking or
+     * cannot be allocated
+     */
+    Lease backfill(unsigned short n_slices, clock::duration hold);
+
+    /**
+     * @brief Allocates n_slices from now until until, as backfill(n_slices,
+     * until - now). A backfill may end exactly when a reservation starts.
+     * @throws invalid_argument if n_slices is invalid or until is not after
+     * now
+     * @throws runtime_error if the allocation conflicts with a booking or
+     * cannot be allocated
+     */
+    Lease backfill(unsigned short n_slices, clock::time_point until);
+
+    /**
+     * @brief Frees a lease returned by claim or backfill and removes it from
+     * the calendar.
+     * @returns false if the lease is unknown or has already expired
+     */
+    bool release(const Lease &lease);
+
+private:
+    struct Booking {
+        clock::time_point start;
+        clock::time_point end;
+        unsigned short n_slices;
+        /// of the instances not yet released; once claimed, the instance of
+        /// leases[i] is at placements[i]
+        std::vector<nvmlGpuInstancePlacement_t> placements;
+        bool claimed;
+        std::vector<std::uint64_t> leases;
+    };
+
+    /**
+     * @brief Chooses placements for n_instances of n_slices in [start, end)
+     * that are disjoint from those of every overlapping booking
+     * @returns false if there are not enough free placements
+     */
+    bool place(clock::time_point start, clock::time_point end,
+               unsigned short n_slices, unsigned short n_instances,
+               std::vector<nvmlGpuInstancePlacement_t> &placements) const;
+
+    /// Frees and forgets the bookings that ended at or before now
+    void prune(clock::time_point now);
+
+    void erase(std::uint64_t id);
+
+    IsolatedGIAllocator &allocator_;
+    /// possible placements of each GPU Instance size, in memory slices, by
+    /// descending start
+    std::map<unsigned short, std::vector<nvmlGpuInstancePlacement_t>>
+        placements_;
+    std::mutex mutex_;
+    std::uint64_t next_booking_id_{1};
+    IntervalTree<clock::time_point, std::uint64_t> calendar_;
+    std::unordered_map<std::uint64_t, Booking> bookings_;
+    std::unordered_map<std::uint64_t, std::uint64_t> lease_bookings_;
+};
+
+}  // namespace nvml
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace nvml {
+
+/**
+ * @brief A hierarchical timer wheel. Timers are scheduled at an absolute tick
+ * and reported once the wheel advances to or past it. Scheduling a timer and
+ * advancing one tick cost O(1) regardless of the number of timers; timers in
+ * the outer levels are cascaded inward once per rotation of the level below.
+ */
+class TimerWheel {
+public:
+    static constexpr unsigned int LEVELS = 4;
+    static constexpr unsigned int SLOT_BITS = 6;
+    static constexpr unsigned int SLOTS = 1u << SLOT_BITS;
+    /// timers further in the future are clamped to this many ticks
+    static constexpr std::uint64_t MAX_DELAY =
+        (std::uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+
+    /**
+     * @brief Schedules id to expire at tick expires. Timers scheduled at or
+     * before now() expire on the next tick, and those more than MAX_DELAY
+     * ticks away expire early, after MAX_DELAY ticks.
+     */
+    void schedule(std::uint64_t id, std::uint64_t expires);
+
+    /**
+     * @brief Advances the wheel to tick, appending the ids of timers that
+     * expired to expired.
+     */
+    void advance(std::uint64_t tick, std::vector<std::uint64_t> &expired);
+
+    /// Returns the current tick
+    std::uint64_t now() const noexcept { return now_; }
+
+    /// Returns the number of scheduled timers
+    std::size_t size() const noexcept { return size_; }
+
+private:
+    struct Timer {
+        std::uint64_t id;
+        std::uint64_t expires;
+    };
+
+    void insert(const Timer &timer);
+
+    std::vector<Timer> slots_[LEVELS][SLOTS];
+    std::uint64_t now_{0};
+    std::size_t size_{0};
+};
+
+}  // namespace nvml
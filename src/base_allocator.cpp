@@ -1,9 +1,17 @@
 #include "nvml_control/allocator.hpp"
 
+#include <algorithm>  // std::sort
+#include <cmath>      // std::ceil
+
 namespace nvml {
 
 namespace {
 const unsigned int A100_N_SLICES = 7;
+
+unsigned int media_engine_count(const nvmlGpuInstanceProfileInfo_t &profile) {
+    return profile.decoderCount + profile.encoderCount + profile.jpegCount +
+           profile.ofaCount;
+}
 }  // anonymous namespace
 
 Allocator::Allocator(GPU &device) : device_(device) {
@@ -15,4 +23,129 @@ Allocator::Allocator(GPU &device) : device_(device) {
     }
 }
 
+void Allocator::try_sample(Sampler &sampler,
+                           nvmlComputeInstance_t instance) noexcept {
+    try {
+        sampler.add(instance);
+    } catch (const std::runtime_error &e) {
+        // sampling is optional; the instance is allocated regardless
+    }
+}
+
+void Allocator::track(const ComputeInstance &instance) noexcept {
+    live_.insert(instance.instance_);
+    if (sampler_) {
+        try_sample(*sampler_, instance.instance_);
+    }
+}
+
+void Allocator::untrack(const ComputeInstance &instance) noexcept {
+    if (sampler_) {
+        sampler_->remove(instance.instance_);
+    }
+    live_.erase(instance.instance_);
+    n_frees_++;
+}
+
+ComputeInstance Allocator::allocate_for(unsigned short n_slices,
+                                        std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        // frees counted before the attempt are reflected in its outcome
+        std::uint64_t n_frees;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            n_frees = n_frees_;
+        }
+        try {
+            return allocate(n_slices);
+        } catch (const std::runtime_error &e) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!cv_.wait_until(lock, deadline,
+                                [&] { return n_frees_ != n_frees; })) {
+                throw;
+            }
+        }
+    }
+}
+
+void Allocator::start_sampler(std::chrono::milliseconds period) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    sampler_.reset();
+    std::unique_ptr<Sampler> sampler(new Sampler(period));
+    for (auto instance : live_) {
+        try_sample(*sampler, instance);
+    }
+    sampler_ = std::move(sampler);
+}
+
+void Allocator::stop_sampler() noexcept {
+    std::unique_lock<std::mutex> lock(mutex_);
+    sampler_.reset();
+}
+
+unsigned int Allocator::required_multiprocessors(const Request &request) const {
+    if (!(request.sm_fraction >= 0.0 && request.sm_fraction <= 1.0)) {
+        throw std::invalid_argument("sm_fraction is out of range");
+    }
+    return static_cast<unsigned int>(
+        std::ceil(request.sm_fraction * device_.multiprocessor_count()));
+}
+
+bool Allocator::fits(const nvmlGpuInstanceProfileInfo_t &profile,
+                     const Request &request,
+                     unsigned int multiprocessors) noexcept {
+    return profile.memorySizeMB >= request.memory_mb &&
+           profile.multiprocessorCount >= multiprocessors &&
+           profile.decoderCount >= request.decoder_count &&
+           profile.encoderCount >= request.encoder_count &&
+           profile.jpegCount >= request.jpeg_count &&
+           profile.ofaCount >= request.ofa_count;
+}
+
+std::vector<nvmlGpuInstanceProfileInfo_t>
+Allocator::fitting_gpu_instance_profiles(const Request &request) const {
+    const unsigned int multiprocessors = required_multiprocessors(request);
+    std::vector<nvmlGpuInstanceProfileInfo_t> ret;
+    for (const auto &profile : device_.gpu_instance_profiles()) {
+        if (fits(profile, request, multiprocessors)) {
+            ret.push_back(profile);
+        }
+    }
+    if (ret.empty()) {
+        throw std::invalid_argument(
+            "request does not fit any GPU Instance profile for this GPU");
+    }
+    // prefer fewer slices, then less memory, then no media extensions
+    std::sort(ret.begin(), ret.end(),
+              [](const nvmlGpuInstanceProfileInfo_t &lhs,
+                 const nvmlGpuInstanceProfileInfo_t &rhs) {
+                  if (lhs.sliceCount != rhs.sliceCount) {
+                      return lhs.sliceCount < rhs.sliceCount;
+                  }
+                  if (lhs.memorySizeMB != rhs.memorySizeMB) {
+                      return lhs.memorySizeMB < rhs.memorySizeMB;
+                  }
+                  return media_engine_count(lhs) < media_engine_count(rhs);
+              });
+    return ret;
+}
+
+std::vector<nvmlComputeInstanceProfileInfo_t>
+Allocator::fitting_compute_instance_profiles(const GPUInstance &gpu_instance,
+                                             unsigned int multiprocessors) {
+    std::vector<nvmlComputeInstanceProfileInfo_t> ret;
+    for (const auto &profile : gpu_instance.compute_instance_profiles()) {
+        if (profile.multiprocessorCount >= multiprocessors) {
+            ret.push_back(profile);
+        }
+    }
+    std::sort(ret.begin(), ret.end(),
+              [](const nvmlComputeInstanceProfileInfo_t &lhs,
+                 const nvmlComputeInstanceProfileInfo_t &rhs) {
+                  return lhs.sliceCount < rhs.sliceCount;
+              });
+    return ret;
+}
+
 }  // namespace nvml
@@ -0,0 +1,121 @@
+#include "nvml_control/allocator.hpp"
+
+#include <limits>
+#include <set>
+
+namespace nvml {
+
+GangAllocator::GangAllocator(std::vector<Allocator *> allocators)
+    : allocators_(std::move(allocators)),
+      distances_(allocators_.size(),
+                 std::vector<unsigned int>(allocators_.size())) {
+    // the topology does not change, so it is only queried once
+    for (std::size_t i = 0; i < allocators_.size(); i++) {
+        for (std::size_t j = i + 1; j < allocators_.size(); j++) {
+            distances_[i][j] = distances_[j][i] =
+                allocators_[i]->device().distance(allocators_[j]->device());
+        }
+    }
+    std::set<int> gpus;
+    for (auto allocator : allocators_) {
+        gpus.insert(allocator->device().device_id_);
+    }
+    n_gpus_ = gpus.size();
+}
+
+unsigned int
+GangAllocator::gang_distance(const std::vector<std::size_t> &gang) const {
+    unsigned int ret{0};
+    for (std::size_t i = 0; i < gang.size(); i++) {
+        for (std::size_t j = i + 1; j < gang.size(); j++) {
+            ret += distances_[gang[i]][gang[j]];
+        }
+    }
+    return ret;
+}
+
+std::vector<ComputeInstance> GangAllocator::allocate(std::size_t n_gpus,
+                                                     unsigned short n_slices) {
+    if (n_gpus == 0 || n_gpus > n_gpus_) {
+        throw std::invalid_argument("n_gpus is out of range");
+    }
+    // the index in allocators_ of one allocator with remaining capacity per
+    // GPU, so that no gang uses a GPU twice
+    std::vector<std::size_t> candidates;
+    std::set<int> gpus;
+    for (std::size_t i = 0; i < allocators_.size(); i++) {
+        if (gpus.count(allocators_[i]->device().device_id_) == 0 &&
+            allocators_[i]->remaining(n_slices) > 0) {
+            gpus.insert(allocators_[i]->device().device_id_);
+            candidates.push_back(i);
+        }
+    }
+    if (candidates.size() < n_gpus) {
+        throw std::runtime_error("Not enough GPUs with remaining capacity");
+    }
+
+    // enumerate every n_gpus-combination of candidates in lexicographic order
+    std::vector<std::size_t> gang(n_gpus), members(n_gpus), best;
+    for (std::size_t i = 0; i < n_gpus; i++) {
+        gang[i] = i;
+    }
+    unsigned int best_distance = std::numeric_limits<unsigned int>::max();
+    for (;;) {
+        for (std::size_t i = 0; i < n_gpus; i++) {
+            members[i] = candidates[gang[i]];
+        }
+        unsigned int distance = gang_distance(members);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = members;
+        }
+        std::size_t i = n_gpus;
+        while (i > 0 && gang[i - 1] == candidates.size() - n_gpus + i - 1) {
+            i--;
+        }
+        if (i == 0) {
+            break;
+        }
+        gang[i - 1]++;
+        for (std::size_t j = i; j < n_gpus; j++) {
+            gang[j] = gang[j - 1] + 1;
+        }
+    }
+
+    std::vector<ComputeInstance> ret;
+    try {
+        for (auto index : best) {
+            ret.push_back(allocators_[index]->allocate(n_slices));
+            std::unique_lock<std::mutex> lock(mutex_);
+            owners_[ret.back().instance_] = allocators_[index];
+        }
+    } catch (...) {
+        free(std::move(ret));
+        throw;
+    }
+    return ret;
+}
+
+void GangAllocator::free(std::vector<ComputeInstance> &&instances) {
+    std::vector<Allocator *> owners;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (const auto &instance : instances) {
+            auto it = owners_.find(instance.instance_);
+            if (it == owners_.end()) {
+                throw std::invalid_argument(
+                    "instance was not allocated by this GangAllocator");
+            }
+            owners.push_back(it->second);
+        }
+        for (const auto &instance : instances) {
+            owners_.erase(instance.instance_);
+        }
+    }
+    for (std::size_t i = 0; i < instances.size(); i++) {
+        owners[i]->free(std::move(instances[i]));
+    }
+    instances.clear();
+}
+
+}  // namespace nvml
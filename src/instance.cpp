@@ -1,12 +1,143 @@
 #include "nvml_control/instance.hpp"
 #include "error.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 namespace nvml {
 
-GPU::GPU(int device) noexcept : device_id_(device) {
-    CHECK_NVML(nvmlDeviceGetHandleByIndex_v2(device, &device_));
+namespace {
+/// Reads the NUMA node of a PCI device from sysfs, -1 if unknown
+int read_numa_node(const nvmlPciInfo_t &pci) {
+    char path[64];
+    std::snprintf(path, sizeof(path),
+                  "/sys/bus/pci/devices/%04x:%02x:%02x.0/numa_node",
+                  pci.domain, pci.bus, pci.device);
+    std::ifstream file(path);
+    int node{-1};
+    if (!(file >> node)) {
+        return -1;
+    }
+    return node;
+}
+
+/// Returns the profile in profiles with profile_id, or an empty profile
+nvmlGpuInstanceProfileInfo_t
+find_profile(const std::vector<nvmlGpuInstanceProfileInfo_t> &profiles,
+             unsigned int profile_id) noexcept {
+    for (const auto &profile : profiles) {
+        if (profile.id == profile_id) {
+            return profile;
+        }
+    }
+    return {};
+}
+
+/// Everything a GPU needs to know about its device
+struct DeviceInfo {
+    nvmlDevice_t device;
+    std::vector<nvmlGpuInstanceProfileInfo_t> gpu_instance_profiles;
+    cpu_set_t cpu_affinity;
+    int numa_node;
+};
+
+DeviceInfo discover_device(unsigned int index) {
+    DeviceInfo ret;
+    THROW_NVML(nvmlDeviceGetHandleByIndex_v2(index, &ret.device));
+    for (unsigned int profile = 0; profile < NVML_GPU_INSTANCE_PROFILE_COUNT;
+         profile++) {
+        nvmlGpuInstanceProfileInfo_t info;
+        // profiles that this GPU does not support are skipped
+        if (nvmlDeviceGetGpuInstanceProfileInfo(ret.device, profile, &info) ==
+            NVML_SUCCESS) {
+            ret.gpu_instance_profiles.push_back(info);
+        }
+    }
+    // the affinity and NUMA node are hints; a GPU that cannot report them,
+    // e.g. because the platform does not support it, is still usable
+    CPU_ZERO(&ret.cpu_affinity);
+    constexpr unsigned int bits = 8 * sizeof(unsigned long);
+    unsigned long cpu_set[CPU_SETSIZE / bits];
+    if (nvmlDeviceGetCpuAffinity(ret.device, CPU_SETSIZE / bits, cpu_set) ==
+        NVML_SUCCESS) {
+        for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (cpu_set[cpu / bits] & (1ul << (cpu % bits))) {
+                CPU_SET(cpu, &ret.cpu_affinity);
+            }
+        }
+    }
+    nvmlPciInfo_t pci;
+    ret.numa_node = nvmlDeviceGetPciInfo(ret.device, &pci) == NVML_SUCCESS
+                        ? read_numa_node(pci)
+                        : -1;
+    return ret;
+}
+
+/// NVML reference count and device cache, guarded by g_nvml_mutex
+std::mutex g_nvml_mutex;
+unsigned int g_nvml_references{0};
+std::vector<std::shared_future<DeviceInfo>> g_devices;
+
+/**
+ * @brief Returns the cached DeviceInfo of index, discovering every device in
+ * parallel on first use. NVML must be initialized.
+ */
+DeviceInfo look_up_device(int index) {
+    std::shared_future<DeviceInfo> device;
+    {
+        std::unique_lock<std::mutex> lock(g_nvml_mutex);
+        if (g_devices.empty()) {
+            unsigned int count{0};
+            THROW_NVML(nvmlDeviceGetCount_v2(&count));
+            for (unsigned int i = 0; i < count; i++) {
+                g_devices.push_back(
+                    std::async(std::launch::async, discover_device, i));
+            }
+        }
+        if (index < 0 || static_cast<std::size_t>(index) >= g_devices.size()) {
+            throw std::runtime_error("GPU device index is out of range");
+        }
+        device = g_devices[index];
+    }
+    // only wait for this device; the others continue in the background
+    return device.get();
+}
+}  // anonymous namespace
+
+NVMLControl::NVMLControl() {
+    std::unique_lock<std::mutex> lock(g_nvml_mutex);
+    if (g_nvml_references == 0) {
+        THROW_NVML(nvmlInit_v2());
+    }
+    g_nvml_references++;
+}
+
+NVMLControl::NVMLControl(const NVMLControl &) noexcept {
+    std::unique_lock<std::mutex> lock(g_nvml_mutex);
+    g_nvml_references++;
+}
+
+NVMLControl::~NVMLControl() {
+    std::unique_lock<std::mutex> lock(g_nvml_mutex);
+    if (--g_nvml_references == 0) {
+        // waits for any discovery still in progress
+        g_devices.clear();
+        CHECK_NVML(nvmlShutdown());
+    }
+}
+
+constexpr unsigned int GPU::NVLINK_DISTANCE;
+
+GPU::GPU(int device) : device_id_(device) {
+    DeviceInfo info = look_up_device(device);
+    device_ = info.device;
+    gpu_instance_profiles_ = std::move(info.gpu_instance_profiles);
+    cpu_affinity_ = info.cpu_affinity;
+    numa_node_ = info.numa_node;
 }
 
 unsigned int
@@ -17,6 +148,54 @@ GPU::remaining_gpu_instance_capacity(unsigned short n_slices) const noexcept {
     return ret;
 }
 
+unsigned int GPU::remaining_gpu_instance_capacity(
+    const nvmlGpuInstanceProfileInfo_t &profile) const noexcept {
+    unsigned int ret{0};
+    CHECK_NVML(
+        nvmlDeviceGetGpuInstanceRemainingCapacity(device_, profile.id, &ret));
+    return ret;
+}
+
+std::vector<nvmlGpuInstancePlacement_t>
+GPU::gpu_instance_placements(unsigned short n_slices) const {
+    const unsigned int profile_id = look_up_gpu_instance_profile_id(n_slices);
+    unsigned int count{0};
+    THROW_NVML(nvmlDeviceGetGpuInstancePossiblePlacements_v2(
+        device_, profile_id, NULL, &count));
+    std::vector<nvmlGpuInstancePlacement_t> ret(count);
+    THROW_NVML(nvmlDeviceGetGpuInstancePossiblePlacements_v2(
+        device_, profile_id, ret.data(), &count));
+    ret.resize(count);
+    return ret;
+}
+
+unsigned int GPU::multiprocessor_count() const noexcept {
+    unsigned int ret{0};
+    for (const auto &profile : gpu_instance_profiles_) {
+        ret = std::max(ret, profile.multiprocessorCount);
+    }
+    return ret;
+}
+
+unsigned int GPU::distance(const GPU &other) const noexcept {
+    if (device_ == other.device_) {
+        return NVML_TOPOLOGY_INTERNAL;
+    }
+    nvmlGpuP2PStatus_t nvlink;
+    if (nvmlDeviceGetP2PStatus(device_, other.device_,
+                               NVML_P2P_CAPS_INDEX_NVLINK,
+                               &nvlink) == NVML_SUCCESS &&
+        nvlink == NVML_P2P_STATUS_OK) {
+        return NVLINK_DISTANCE;
+    }
+    nvmlGpuTopologyLevel_t level;
+    if (nvmlDeviceGetTopologyCommonAncestor(device_, other.device_, &level) !=
+        NVML_SUCCESS) {
+        return NVML_TOPOLOGY_SYSTEM;
+    }
+    return level;
+}
+
 unsigned int
 GPU::look_up_gpu_instance_profile_id(unsigned short n_slices) const {
     // hard-coded for A100 MIG, these values could be different on other GPUs
@@ -48,52 +227,36 @@ GPU::look_up_compute_instance_profile_id(unsigned short n_slices) const {
     }
 }
 
-GPUInstance::GPUInstance(GPU &gpu, unsigned short size) : gpu_(&gpu) {
+GPUInstance::GPUInstance(GPU &gpu, unsigned short size)
+    : nvml_(new NVMLControl(gpu.nvml_)), gpu_(&gpu) {
     // look up profile_id (TODO use nvml API)
     unsigned int profile_id = gpu.look_up_gpu_instance_profile_id(size);
-
-    // we would like to use this API, but it doesnt seem to work and isn't
-    // publicly documented.
-    // THROW_NVML(nvmlDeviceCreateGpuInstanceWithPlacement( gpu.device_,
-    // profile_id,
-    // &placement, &instance_));
     THROW_NVML(
         nvmlDeviceCreateGpuInstance(gpu.device_, profile_id, &instance_));
     valid_ = true;
+    profile_ = find_profile(gpu.gpu_instance_profiles_, profile_id);
+}
 
-    /* TODO move to allocator
-    constexpr unsigned int A100_MAX_PLACEMENTS = 7;
-    nvmlGpuInstancePlacement_t placements[A100_MAX_PLACEMENTS];
-    unsigned int count;
-    THROW_NVML(nvmlDeviceGetGpuInstancePossiblePlacements(
-        gpu.device_, profile_id, placements, &count));
-    bool valid = false;
-    for (unsigned int i = 0; i < count; i++)
-    {
-        if (placements[i].start == placement.start && placements[i].size ==
-   placement.size)
-        {
-            valid = true;
-            break;
-        }
-    }
-    if (!valid)
-    {
-        throw std::runtime_error("No available placements for requested
-   profile");
-    }
-    std::stack<GPUInstance> instances;
-    do {
-        // create an instance
-        instances.emplace(gpu_, placement.size);
-        // check the placement
-    } while (instances.top().placement())
-        // repeat until the instance is at the requested placement.
-*/
+GPUInstance::GPUInstance(GPU &gpu, unsigned short size,
+                         const nvmlGpuInstancePlacement_t &placement)
+    : nvml_(new NVMLControl(gpu.nvml_)), gpu_(&gpu) {
+    unsigned int profile_id = gpu.look_up_gpu_instance_profile_id(size);
+    THROW_NVML(nvmlDeviceCreateGpuInstanceWithPlacement(
+        gpu.device_, profile_id, &placement, &instance_));
+    valid_ = true;
+    profile_ = find_profile(gpu.gpu_instance_profiles_, profile_id);
+}
+
+GPUInstance::GPUInstance(GPU &gpu, const nvmlGpuInstanceProfileInfo_t &profile)
+    : nvml_(new NVMLControl(gpu.nvml_)), gpu_(&gpu), profile_(profile) {
+    THROW_NVML(
+        nvmlDeviceCreateGpuInstance(gpu.device_, profile.id, &instance_));
+    valid_ = true;
 }
 
 GPUInstance::GPUInstance(GPUInstance &&rhs) noexcept
-    : valid_(rhs.valid_), gpu_(rhs.gpu_), instance_(rhs.instance_) {
+    : nvml_(std::move(rhs.nvml_)), valid_(rhs.valid_), gpu_(rhs.gpu_),
+      instance_(rhs.instance_), profile_(rhs.profile_) {
     rhs.valid_ = false;
     rhs.gpu_ = NULL;
     rhs.instance_ = NULL;
@@ -106,9 +269,11 @@ GPUInstance::~GPUInstance() noexcept {
 }
 
 GPUInstance &GPUInstance::operator=(GPUInstance &&rhs) noexcept {
+    nvml_ = std::move(rhs.nvml_);
     valid_ = rhs.valid_;
     gpu_ = rhs.gpu_;
     instance_ = rhs.instance_;
+    profile_ = rhs.profile_;
     rhs.valid_ = false;
     rhs.gpu_ = NULL;
     rhs.instance_ = NULL;
@@ -124,6 +289,39 @@ unsigned int GPUInstance::remaining_compute_instance_capacity(
     return count;
 }
 
+unsigned int GPUInstance::remaining_compute_instance_capacity(
+    const nvmlComputeInstanceProfileInfo_t &profile) const noexcept {
+    unsigned int count;
+    CHECK_NVML(nvmlGpuInstanceGetComputeInstanceRemainingCapacity(
+        instance_, profile.id, &count));
+    return count;
+}
+
+std::vector<nvmlComputeInstanceProfileInfo_t>
+GPUInstance::compute_instance_profiles() const {
+    std::vector<nvmlComputeInstanceProfileInfo_t> ret;
+    for (unsigned int profile = 0;
+         profile < NVML_COMPUTE_INSTANCE_PROFILE_COUNT; profile++) {
+        nvmlComputeInstanceProfileInfo_t info;
+        // profiles larger than this GPU Instance are not supported
+        if (nvmlGpuInstanceGetComputeInstanceProfileInfo(
+                instance_, profile, NVML_COMPUTE_INSTANCE_ENGINE_PROFILE_SHARED,
+                &info) == NVML_SUCCESS) {
+            ret.push_back(info);
+        }
+    }
+    return ret;
+}
+
+nvmlComputeInstanceProfileInfo_t
+GPUInstance::compute_instance_profile(unsigned short n_slices) const {
+    nvmlComputeInstanceProfileInfo_t info;
+    THROW_NVML(nvmlGpuInstanceGetComputeInstanceProfileInfo(
+        instance_, gpu_->look_up_compute_instance_profile_id(n_slices),
+        NVML_COMPUTE_INSTANCE_ENGINE_PROFILE_SHARED, &info));
+    return info;
+}
+
 nvmlGpuInstancePlacement_t GPUInstance::get_placement() const noexcept {
     nvmlGpuInstanceInfo_t info;
     CHECK_NVML(nvmlGpuInstanceGetInfo(instance_, &info));
@@ -132,27 +330,60 @@ nvmlGpuInstancePlacement_t GPUInstance::get_placement() const noexcept {
 
 ComputeInstance::ComputeInstance(GPUInstance &&gpu_instance,
                                  unsigned int n_slices)
-    : valid_(true), managed_(std::move(gpu_instance)) {
-    THROW_NVML(nvmlGpuInstanceCreateComputeInstance(
-        managed_.instance_,
-        gpu_instance.gpu_->look_up_compute_instance_profile_id(n_slices),
-        &instance_));
+    : managed_(std::move(gpu_instance)) {
+    create(managed_, managed_.compute_instance_profile(n_slices));
 }
 
 ComputeInstance::ComputeInstance(GPUInstance &gpu_instance,
-                                 unsigned int n_slices)
-    : valid_(true) {
-    THROW_NVML(nvmlGpuInstanceCreateComputeInstance(
-        gpu_instance.instance_,
-        gpu_instance.gpu_->look_up_compute_instance_profile_id(n_slices),
-        &instance_));
+                                 unsigned int n_slices) {
+    create(gpu_instance, gpu_instance.compute_instance_profile(n_slices));
+}
+
+ComputeInstance::ComputeInstance(
+    GPUInstance &&gpu_instance, const nvmlComputeInstanceProfileInfo_t &profile)
+    : managed_(std::move(gpu_instance)) {
+    create(managed_, profile);
+}
+
+ComputeInstance::ComputeInstance(
+    GPUInstance &gpu_instance,
+    const nvmlComputeInstanceProfileInfo_t &profile) {
+    create(gpu_instance, profile);
+}
+
+void ComputeInstance::create(const GPUInstance &gpu_instance,
+                             const nvmlComputeInstanceProfileInfo_t &profile) {
+    THROW_NVML(nvmlGpuInstanceCreateComputeInstance(gpu_instance.instance_,
+                                                    profile.id, &instance_));
+    nvml_.reset(new NVMLControl(*gpu_instance.nvml_));
+    valid_ = true;
+    device_id_ = gpu_instance.gpu_->device_id_;
+    cpu_affinity_ = gpu_instance.gpu_->cpu_affinity();
+    numa_node_ = gpu_instance.gpu_->numa_node();
+    const auto &gpu_instance_profile = gpu_instance.profile_;
+    shape_.gpu_instance_profile_id = gpu_instance_profile.id;
+    shape_.compute_instance_profile_id = profile.id;
+    shape_.gpu_instance_slices = gpu_instance_profile.sliceCount;
+    shape_.compute_instance_slices = profile.sliceCount;
+    shape_.memory_mb = gpu_instance_profile.memorySizeMB;
+    shape_.multiprocessor_count = profile.multiprocessorCount;
+    shape_.copy_engine_count = gpu_instance_profile.copyEngineCount;
+    shape_.decoder_count = gpu_instance_profile.decoderCount;
+    shape_.encoder_count = gpu_instance_profile.encoderCount;
+    shape_.jpeg_count = gpu_instance_profile.jpegCount;
+    shape_.ofa_count = gpu_instance_profile.ofaCount;
 }
 
 ComputeInstance::ComputeInstance(ComputeInstance &&rhs) noexcept
-    : valid_(rhs.valid_), instance_(rhs.instance_),
-      managed_(std::move(rhs.managed_)) {
+    : nvml_(std::move(rhs.nvml_)), valid_(rhs.valid_),
+      instance_(rhs.instance_), managed_(std::move(rhs.managed_)),
+      shape_(rhs.shape_), device_id_(rhs.device_id_),
+      cpu_affinity_(rhs.cpu_affinity_), numa_node_(rhs.numa_node_) {
     rhs.valid_ = false;
     rhs.instance_ = NULL;
+    rhs.device_id_ = -1;
+    CPU_ZERO(&rhs.cpu_affinity_);
+    rhs.numa_node_ = -1;
 }
 
 ComputeInstance::~ComputeInstance() noexcept {
@@ -162,11 +393,19 @@ ComputeInstance::~ComputeInstance() noexcept {
 }
 
 ComputeInstance &ComputeInstance::operator=(ComputeInstance &&rhs) noexcept {
+    nvml_ = std::move(rhs.nvml_);
     valid_ = rhs.valid_;
     instance_ = rhs.instance_;
     managed_ = std::move(rhs.managed_);
+    shape_ = rhs.shape_;
+    device_id_ = rhs.device_id_;
+    cpu_affinity_ = rhs.cpu_affinity_;
+    numa_node_ = rhs.numa_node_;
     rhs.valid_ = false;
     rhs.instance_ = NULL;
+    rhs.device_id_ = -1;
+    CPU_ZERO(&rhs.cpu_affinity_);
+    rhs.numa_node_ = -1;
     return *this;
 }
 
@@ -194,17 +433,4 @@ std::string ComputeInstance::get_cuda_visible_devices_string() const noexcept {
     return visible_device.str();
 }
 
-NVMLControl::NVMLControl() {
-    CHECK_NVML(nvmlInit_v2());
-}
-
-NVMLControl::~NVMLControl() {
-    CHECK_NVML(nvmlShutdown());
-}
-
-namespace {
-/// Automatically initialize nvml when this library loads
-NVMLControl g_nvml_control;
-}  // anonymous namespace
-
 }  // namespace nvml
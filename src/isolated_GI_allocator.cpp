@@ -9,6 +9,10 @@ namespace {
 const unsigned int A100_N_SLICES = 7;
 }  // anonymous namespace
 
+IsolatedGIAllocator::~IsolatedGIAllocator() noexcept {
+    release_leases();
+}
+
 ComputeInstance IsolatedGIAllocator::allocate(unsigned short n_slices) {
     if (n_slices == 0 || n_slices > A100_N_SLICES) {
         // not possibly to satisfy invalid requests
@@ -17,9 +21,46 @@ ComputeInstance IsolatedGIAllocator::allocate(unsigned short n_slices) {
     std::unique_lock<std::mutex> lock(mutex_);
     GPUInstance gpu_instance(device_, n_slices);
     ComputeInstance compute_instance(std::move(gpu_instance), n_slices);
+    track(compute_instance);
+    return compute_instance;
+}
+
+ComputeInstance
+IsolatedGIAllocator::allocate(unsigned short n_slices,
+                              const nvmlGpuInstancePlacement_t &placement) {
+    if (n_slices == 0 || n_slices > A100_N_SLICES) {
+        throw std::invalid_argument("n_slices is out of range");
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    GPUInstance gpu_instance(device_, n_slices, placement);
+    ComputeInstance compute_instance(std::move(gpu_instance), n_slices);
+    track(compute_instance);
     return compute_instance;
 }
 
+ComputeInstance IsolatedGIAllocator::allocate(const Request &request) {
+    const unsigned int multiprocessors = required_multiprocessors(request);
+    const auto profiles = fitting_gpu_instance_profiles(request);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto &profile : profiles) {
+        if (device_.remaining_gpu_instance_capacity(profile) == 0) {
+            // fall back to the next larger profile
+            continue;
+        }
+        GPUInstance gpu_instance(device_, profile);
+        const auto compute_profiles =
+            fitting_compute_instance_profiles(gpu_instance, multiprocessors);
+        if (compute_profiles.empty()) {
+            continue;
+        }
+        ComputeInstance compute_instance(std::move(gpu_instance),
+                                         compute_profiles.front());
+        track(compute_instance);
+        return compute_instance;
+    }
+    throw std::runtime_error("No GPU Instance capacity for request");
+}
+
 unsigned int
 IsolatedGIAllocator::remaining(unsigned short n_slices) const noexcept {
     return device_.remaining_gpu_instance_capacity(n_slices);
@@ -27,6 +68,7 @@ IsolatedGIAllocator::remaining(unsigned short n_slices) const noexcept {
 
 void IsolatedGIAllocator::free(ComputeInstance &&instance) {
     std::unique_lock<std::mutex> lock(mutex_);
+    untrack(instance);
     { ComputeInstance free_on_scope_exit = std::move(instance); }
     cv_.notify_all();
 }
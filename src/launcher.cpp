@@ -0,0 +1,351 @@
+#include "nvml_control/launcher.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/sched.h>  // clone_args
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+
+extern char **environ;
+
+// the same on every architecture
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef P_PIDFD
+#define P_PIDFD 3  // glibc < 2.36
+#endif
+
+namespace nvml {
+
+namespace {
+/// epoll data of the event fd; children are tagged with their job id
+constexpr std::uint64_t WAKE_TAG = ~std::uint64_t{0};
+constexpr int MAX_EVENTS = 64;
+constexpr char CUDA_VISIBLE_DEVICES[] = "CUDA_VISIBLE_DEVICES=";
+
+std::system_error system_error(int error, const char *what) {
+    return std::system_error(error, std::generic_category(), what);
+}
+
+/**
+ * @brief Reaps the child of pidfd without blocking
+ * @returns 1 and sets status, in the format of waitpid, if the child was
+ * reaped; 0 if it has not exited; -1 if it cannot be reaped, e.g. because
+ * SIGCHLD is ignored or another waiter reaped it first
+ */
+int reap(int pidfd, int &status) noexcept {
+    siginfo_t info;
+    std::memset(&info, 0, sizeof(info));
+    if (waitid(static_cast<idtype_t>(P_PIDFD), pidfd, &info,
+               WEXITED | WNOHANG) != 0) {
+        return -1;
+    }
+    if (info.si_pid == 0) {
+        return 0;
+    }
+    switch (info.si_code) {
+    case CLD_EXITED: status = (info.si_status & 0xff) << 8; break;
+    case CLD_DUMPED: status = info.si_status | 0x80; break;
+    default: status = info.si_status; break;  // CLD_KILLED
+    }
+    return 1;
+}
+
+/// Kills the child of pidfd, which cannot have been replaced by another
+/// process, and waits for it to exit
+void kill_and_reap(int pidfd) noexcept {
+    syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0);
+    waitid(static_cast<idtype_t>(P_PIDFD), pidfd, NULL, WEXITED);
+}
+
+/**
+ * @brief Spawns argv like posix_spawnp, but also returns a pidfd of the
+ * child, created with it so that the child cannot be reaped before it is
+ * pinned. Returns once the child has called exec.
+ * @returns 0, or an error number as posix_spawnp does. ENOSYS if clone3 is
+ * unavailable, e.g. filtered by seccomp.
+ */
+int spawn_pidfd(pid_t &pid, int &pidfd, char *const argv[],
+                char *const envp[]) noexcept {
+    // the child reports a failed exec through the pipe, which a successful
+    // exec closes
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        return errno;
+    }
+    clone_args args{};
+    args.flags = CLONE_PIDFD;
+    args.pidfd = reinterpret_cast<std::uint64_t>(&pidfd);
+    args.exit_signal = SIGCHLD;
+    const long ret = syscall(SYS_clone3, &args, sizeof(args));
+    if (ret == 0) {
+        // the child of a multithreaded process; execvpe does not allocate
+        execvpe(argv[0], argv, envp);
+        const int error = errno;
+        (void)!write(pipe_fds[1], &error, sizeof(error));
+        _exit(127);
+    }
+    int error = errno;
+    close(pipe_fds[1]);
+    if (ret < 0) {
+        close(pipe_fds[0]);
+        return error;
+    }
+    ssize_t n;
+    do {
+        n = read(pipe_fds[0], &error, sizeof(error));
+    } while (n < 0 && errno == EINTR);
+    close(pipe_fds[0]);
+    if (n == sizeof(error)) {
+        waitid(static_cast<idtype_t>(P_PIDFD), pidfd, NULL, WEXITED);
+        close(pidfd);
+        return error;
+    }
+    pid = static_cast<pid_t>(ret);
+    return 0;
+}
+}  // anonymous namespace
+
+constexpr int Launcher::UNKNOWN_STATUS;
+
+Launcher::Launcher(Allocator &allocator)
+    : allocator_(allocator), epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      event_fd_(eventfd(0, EFD_CLOEXEC)) {
+    if (epoll_fd_ < 0 || event_fd_ < 0) {
+        int error = errno;
+        close(epoll_fd_);
+        close(event_fd_);
+        throw system_error(error, "Launcher");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TAG;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) != 0) {
+        int error = errno;
+        close(epoll_fd_);
+        close(event_fd_);
+        throw system_error(error, "epoll_ctl");
+    }
+    monitor_ = std::thread(&Launcher::monitor, this);
+}
+
+Launcher::~Launcher() noexcept {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return children_.empty(); });
+        stop_ = true;
+    }
+    std::uint64_t one = 1;
+    (void)write(event_fd_, &one, sizeof(one));
+    monitor_.join();
+    close(event_fd_);
+    close(epoll_fd_);
+}
+
+Job Launcher::launch(unsigned short n_slices,
+                     const std::vector<std::string> &argv) {
+    if (argv.empty()) {
+        throw std::invalid_argument("argv is empty");
+    }
+    const auto start = std::chrono::steady_clock::now();
+    return spawn(allocator_.allocate(n_slices), start, argv);
+}
+
+Job Launcher::launch(const Request &request,
+                     const std::vector<std::string> &argv) {
+    if (argv.empty()) {
+        throw std::invalid_argument("argv is empty");
+    }
+    const auto start = std::chrono::steady_clock::now();
+    return spawn(allocator_.allocate(request), start, argv);
+}
+
+Job Launcher::spawn(ComputeInstance &&instance,
+                    std::chrono::steady_clock::time_point start,
+                    const std::vector<std::string> &argv) {
+    Job job;
+    job.allocate_latency = std::chrono::steady_clock::now() - start;
+    job.cuda_visible_devices = instance.get_cuda_visible_devices_string();
+    job.shape = instance.get_shape();
+
+    // the environment of this process with CUDA_VISIBLE_DEVICES replaced
+    const std::string visible_devices =
+        CUDA_VISIBLE_DEVICES + job.cuda_visible_devices;
+    std::vector<char *> envp;
+    for (char **var = environ; *var != NULL; var++) {
+        if (std::strncmp(*var, CUDA_VISIBLE_DEVICES,
+                         sizeof(CUDA_VISIBLE_DEVICES) - 1) != 0) {
+            envp.push_back(*var);
+        }
+    }
+    envp.push_back(const_cast<char *>(visible_devices.c_str()));
+    envp.push_back(NULL);
+    std::vector<char *> args;
+    for (const auto &arg : argv) {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(NULL);
+
+    int pidfd{-1};
+    int error = spawn_pidfd(job.pid, pidfd, args.data(), envp.data());
+    if (error == ENOSYS) {
+        // glibc's posix_spawn returns once the child has called exec
+        error = posix_spawnp(&job.pid, args[0], NULL, NULL, args.data(),
+                             envp.data());
+    }
+    if (error != 0) {
+        allocator_.free(std::move(instance));
+        throw system_error(error, "spawn");
+    }
+    job.allocate_to_exec_latency = std::chrono::steady_clock::now() - start;
+    if (pidfd < 0) {
+        // spawned by posix_spawnp, so the child may already have been reaped
+        pidfd = static_cast<int>(syscall(SYS_pidfd_open, job.pid, 0));
+        if (pidfd < 0) {
+            return unpinned(std::move(instance), std::move(job), errno);
+        }
+    }
+
+    // the monitor cannot see the pidfd before the child is recorded, since
+    // it looks children up under the lock
+    std::unique_lock<std::mutex> lock(mutex_);
+    job.id = next_job_id_++;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = job.id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd, &event) != 0) {
+        // an unwatched child would never free its instance
+        error = errno;
+        lock.unlock();
+        kill_and_reap(pidfd);
+        close(pidfd);
+        allocator_.free(std::move(instance));
+        throw system_error(error, "epoll_ctl");
+    }
+    children_.emplace(job.id, Child{std::move(instance), pidfd, false});
+    return job;
+}
+
+Job Launcher::unpinned(ComputeInstance &&instance, Job &&job, int error) {
+    if (error == ESRCH) {
+        // the child has already exited and been reaped, e.g. because
+        // SIGCHLD is ignored
+        allocator_.free(std::move(instance));
+        std::unique_lock<std::mutex> lock(mutex_);
+        job.id = next_job_id_++;
+        exited_[job.id] = UNKNOWN_STATUS;
+        return std::move(job);
+    }
+    // without a pidfd the child cannot be watched, and its pid may be
+    // reused once it is reaped, so it must not be signalled. Wait for it
+    // instead of freeing the instance under it.
+    while (waitpid(job.pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    allocator_.free(std::move(instance));
+    throw system_error(error, "pidfd_open");
+}
+
+int Launcher::wait(const Job &job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto child = children_.find(job.id);
+    if ((child == children_.end() || child->second.detached) &&
+        exited_.count(job.id) == 0) {
+        throw std::invalid_argument("job is not a child of this Launcher");
+    }
+    cv_.wait(lock, [&] { return exited_.count(job.id) != 0; });
+    auto it = exited_.find(job.id);
+    int status = it->second;
+    exited_.erase(it);
+    return status;
+}
+
+bool Launcher::detach(const Job &job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (exited_.erase(job.id) != 0) {
+        return true;
+    }
+    auto child = children_.find(job.id);
+    if (child == children_.end() || child->second.detached) {
+        return false;
+    }
+    child->second.detached = true;
+    return true;
+}
+
+std::size_t Launcher::running() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return children_.size();
+}
+
+void Launcher::monitor() noexcept {
+    epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            continue;  // EINTR
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == WAKE_TAG) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (stop_) {
+                    return;
+                }
+                continue;
+            }
+            // the pidfd is readable once the child has exited
+            const std::uint64_t id = events[i].data.u64;
+            ComputeInstance instance;
+            int status{UNKNOWN_STATUS};
+            bool detached;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto it = children_.find(id);
+                if (it == children_.end()) {
+                    continue;  // already removed
+                }
+                Child &child = it->second;
+                if (reap(child.pidfd, status) == 0) {
+                    continue;
+                }
+                // a child reaped elsewhere has exited all the same, with an
+                // unknown status
+                instance = std::move(child.instance);
+                detached = child.detached;
+                // a process forking concurrently may hold a copy of the
+                // pidfd, which would keep it in the epoll set after close
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, child.pidfd, NULL);
+                close(child.pidfd);
+            }
+            try {
+                allocator_.free(std::move(instance));
+            } catch (const std::runtime_error &e) {
+                // the instance is destroyed when it goes out of scope
+            }
+            {
+                // the child stays in children_ until its instance is freed
+                std::unique_lock<std::mutex> lock(mutex_);
+                children_.erase(id);
+                if (!detached) {
+                    exited_[id] = status;
+                }
+            }
+            cv_.notify_all();
+        }
+    }
+}
+
+}  // namespace nvml
@@ -0,0 +1,140 @@
+#include "nvml_control/allocator.hpp"
+
+#include <algorithm>  // std::min
+
+namespace nvml {
+
+namespace {
+/// The resolution of lease expiry
+constexpr std::chrono::milliseconds LEASE_TICK(10);
+}  // anonymous namespace
+
+Lease Allocator::lease(ComputeInstance &&instance,
+                       std::chrono::milliseconds ttl,
+                       std::chrono::steady_clock::time_point not_after) {
+    Lease ret;
+    ret.cuda_visible_devices = instance.get_cuda_visible_devices_string();
+    ret.shape = instance.get_shape();
+    const auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(lease_mutex_);
+    if (!reaper_.joinable()) {
+        lease_epoch_ = now;
+        reaper_ = std::thread(&Allocator::reap, this);
+    }
+    ret.id = next_lease_id_++;
+    const auto deadline = std::min<std::chrono::steady_clock::time_point>(
+        now + ttl, not_after);
+    leases_.emplace(ret.id,
+                    LeaseRecord{std::move(instance), ttl, deadline, not_after});
+    lease_wheel_.schedule(ret.id, lease_tick(deadline));
+    return ret;
+}
+
+bool Allocator::heartbeat(const Lease &lease) {
+    const auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(lease_mutex_);
+    auto it = leases_.find(lease.id);
+    if (it == leases_.end()) {
+        return false;
+    }
+    // the timer is left in place; the reaper reschedules it when it fires
+    // before the new deadline
+    it->second.deadline = std::min(now + it->second.ttl, it->second.not_after);
+    return true;
+}
+
+bool Allocator::release(const Lease &lease) {
+    ComputeInstance instance;
+    {
+        std::unique_lock<std::mutex> lock(lease_mutex_);
+        auto it = leases_.find(lease.id);
+        if (it == leases_.end()) {
+            // the lease may be expiring; wait until its instance is freed
+            lease_cv_.wait(lock, [this] { return reclaiming_ == 0; });
+            return false;
+        }
+        // the timer fires later and finds no record
+        instance = std::move(it->second.instance);
+        leases_.erase(it);
+    }
+    free(std::move(instance));
+    return true;
+}
+
+std::uint64_t Allocator::lease_tick(
+    std::chrono::steady_clock::time_point time) const noexcept {
+    const auto since_epoch = time - lease_epoch_;
+    if (since_epoch <= std::chrono::steady_clock::duration::zero()) {
+        // a not_after before the reaper started expires on the next tick
+        return 0;
+    }
+    return (since_epoch + LEASE_TICK - std::chrono::nanoseconds(1)) /
+           LEASE_TICK;
+}
+
+void Allocator::reap() noexcept {
+    std::vector<std::uint64_t> expired;
+    std::vector<ComputeInstance> reclaimed;
+    std::unique_lock<std::mutex> lock(lease_mutex_);
+    while (!lease_stop_) {
+        lease_cv_.wait_for(lock, LEASE_TICK, [this] { return lease_stop_; });
+        if (lease_stop_) {
+            break;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        expired.clear();
+        lease_wheel_.advance((now - lease_epoch_) / LEASE_TICK, expired);
+        for (auto id : expired) {
+            auto it = leases_.find(id);
+            if (it == leases_.end()) {
+                // released
+                continue;
+            }
+            if (it->second.deadline > now) {
+                // renewed by heartbeat
+                lease_wheel_.schedule(id, lease_tick(it->second.deadline));
+                continue;
+            }
+            reclaimed.push_back(std::move(it->second.instance));
+            leases_.erase(it);
+        }
+        if (reclaimed.empty()) {
+            continue;
+        }
+        // free without the lease lock so heartbeats are not delayed
+        reclaiming_ = reclaimed.size();
+        lock.unlock();
+        for (auto &instance : reclaimed) {
+            try {
+                free(std::move(instance));
+            } catch (const std::runtime_error &e) {
+                // the instance is destroyed when reclaimed is cleared
+            }
+        }
+        reclaimed.clear();
+        lock.lock();
+        reclaiming_ = 0;
+        lease_cv_.notify_all();
+    }
+}
+
+void Allocator::release_leases() noexcept {
+    {
+        std::unique_lock<std::mutex> lock(lease_mutex_);
+        lease_stop_ = true;
+    }
+    lease_cv_.notify_all();
+    if (reaper_.joinable()) {
+        reaper_.join();
+    }
+    for (auto &entry : leases_) {
+        try {
+            free(std::move(entry.second.instance));
+        } catch (const std::runtime_error &e) {
+            // destroyed when leases_ is cleared
+        }
+    }
+    leases_.clear();
+}
+
+}  // namespace nvml
@@ -0,0 +1,150 @@
+#include "nvml_control/sampler.hpp"
+#include "error.hpp"
+
+#include <algorithm>  // std::max
+
+namespace nvml {
+
+namespace {
+/// Finds the MIG device handle of a Compute Instance
+nvmlDevice_t look_up_mig_device(nvmlComputeInstance_t instance) {
+    nvmlComputeInstanceInfo_t compute_instance_info;
+    THROW_NVML(nvmlComputeInstanceGetInfo(instance, &compute_instance_info));
+    nvmlGpuInstanceInfo_t gpu_instance_info;
+    THROW_NVML(nvmlGpuInstanceGetInfo(compute_instance_info.gpuInstance,
+                                      &gpu_instance_info));
+    unsigned int count{0};
+    THROW_NVML(
+        nvmlDeviceGetMaxMigDeviceCount(compute_instance_info.device, &count));
+    for (unsigned int i = 0; i < count; i++) {
+        nvmlDevice_t mig_device;
+        unsigned int gpu_instance_id, compute_instance_id;
+        if (nvmlDeviceGetMigDeviceHandleByIndex(compute_instance_info.device,
+                                                i, &mig_device) !=
+                NVML_SUCCESS ||
+            nvmlDeviceGetGpuInstanceId(mig_device, &gpu_instance_id) !=
+                NVML_SUCCESS ||
+            nvmlDeviceGetComputeInstanceId(mig_device, &compute_instance_id) !=
+                NVML_SUCCESS) {
+            continue;
+        }
+        if (gpu_instance_id == gpu_instance_info.id &&
+            compute_instance_id == compute_instance_info.id) {
+            return mig_device;
+        }
+    }
+    throw std::runtime_error("No MIG device for Compute Instance");
+}
+
+/// Reads a sample, returns false if the MIG device could not be read
+bool take_sample(nvmlDevice_t mig_device, Sample &sample) noexcept {
+    nvmlMemory_t memory;
+    if (nvmlDeviceGetMemoryInfo(mig_device, &memory) != NVML_SUCCESS) {
+        return false;
+    }
+    sample.memory_used = memory.used;
+    sample.memory_total = memory.total;
+    // with no buffer NVML only reports the number of processes
+    unsigned int process_count{0};
+    nvmlReturn_t ret =
+        nvmlDeviceGetComputeRunningProcesses(mig_device, &process_count, NULL);
+    if (ret != NVML_SUCCESS && ret != NVML_ERROR_INSUFFICIENT_SIZE) {
+        return false;
+    }
+    sample.process_count = process_count;
+    return true;
+}
+}  // anonymous namespace
+
+Sampler::Sampler(std::chrono::milliseconds period)
+    : period_(period), thread_(&Sampler::run, this) {}
+
+Sampler::~Sampler() noexcept {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void Sampler::add(nvmlComputeInstance_t instance) {
+    auto series = std::make_shared<Series>();
+    series->mig_device = look_up_mig_device(instance);
+    std::unique_lock<std::mutex> lock(mutex_);
+    series_[instance] = std::move(series);
+}
+
+void Sampler::remove(nvmlComputeInstance_t instance) noexcept {
+    std::unique_lock<std::mutex> lock(mutex_);
+    series_.erase(instance);
+}
+
+std::shared_ptr<const Sampler::Series>
+Sampler::find(nvmlComputeInstance_t instance) const noexcept {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = series_.find(instance);
+    if (it == series_.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+std::vector<Sample> Sampler::recent(const ComputeInstance &instance,
+                                    std::size_t n) const {
+    auto series = find(instance.instance_);
+    if (!series) {
+        return {};
+    }
+    return series->samples.recent(n);
+}
+
+Utilization
+Sampler::aggregate(const ComputeInstance &instance,
+                   std::chrono::steady_clock::duration window) const {
+    Utilization ret;
+    const auto since = std::chrono::steady_clock::now() - window;
+    unsigned long long memory_used_sum{0};
+    std::size_t active{0};
+    for (const auto &sample : recent(instance)) {
+        if (sample.time < since) {
+            continue;
+        }
+        ret.n_samples++;
+        ret.memory_total = sample.memory_total;
+        ret.max_memory_used = std::max(ret.max_memory_used, sample.memory_used);
+        memory_used_sum += sample.memory_used;
+        if (sample.process_count > 0) {
+            active++;
+        }
+    }
+    if (ret.n_samples > 0) {
+        ret.mean_memory_used = memory_used_sum / ret.n_samples;
+        ret.active_fraction = static_cast<double>(active) / ret.n_samples;
+    }
+    return ret;
+}
+
+void Sampler::run() noexcept {
+    std::vector<std::shared_ptr<Series>> snapshot;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        snapshot.clear();
+        for (const auto &entry : series_) {
+            snapshot.push_back(entry.second);
+        }
+        // sample without the lock so queries and allocations are not delayed
+        lock.unlock();
+        for (const auto &series : snapshot) {
+            Sample sample;
+            sample.time = std::chrono::steady_clock::now();
+            if (take_sample(series->mig_device, sample)) {
+                series->samples.push(sample);
+            }
+        }
+        lock.lock();
+        cv_.wait_for(lock, period_, [this] { return stop_; });
+    }
+}
+
+}  // namespace nvml
@@ -0,0 +1,230 @@
+#include "nvml_control/scheduler.hpp"
+
+#include <algorithm>  // std::sort, std::find
+#include <thread>
+
+namespace nvml {
+
+namespace {
+// hard-coded for A100 slice sizes
+constexpr unsigned short A100_SLICE_SIZES[] = {1, 2, 3, 4, 7};
+
+/// Returns the memory slices occupied by placement as a bit mask
+unsigned long long mask(const nvmlGpuInstancePlacement_t &placement) {
+    return ((1ull << placement.size) - 1) << placement.start;
+}
+}  // anonymous namespace
+
+Scheduler::Scheduler(IsolatedGIAllocator &allocator) : allocator_(allocator) {
+    for (auto n_slices : A100_SLICE_SIZES) {
+        auto &placements = placements_[n_slices];
+        placements = allocator_.device().gpu_instance_placements(n_slices);
+        // the larger profiles can only be placed at the low slices, so the
+        // smaller ones are placed from the top down
+        std::sort(placements.begin(), placements.end(),
+                  [](const nvmlGpuInstancePlacement_t &lhs,
+                     const nvmlGpuInstancePlacement_t &rhs) {
+                      return lhs.start > rhs.start;
+                  });
+    }
+}
+
+bool Scheduler::place(
+    clock::time_point start, clock::time_point end, unsigned short n_slices,
+    unsigned short n_instances,
+    std::vector<nvmlGpuInstancePlacement_t> &placements) const {
+    // booked placements are fixed, so every overlapping booking excludes its
+    // slices for the whole window
+    unsigned long long occupied{0};
+    calendar_.overlapping(
+        start, end,
+        [&](clock::time_point, clock::time_point, std::uint64_t id) {
+            for (const auto &placement : bookings_.at(id).placements) {
+                occupied |= mask(placement);
+            }
+        });
+    // the placements of one size all have the same size and are sorted by
+    // start, so taking the first free one each time places as many instances
+    // as possible
+    placements.clear();
+    for (const auto &placement : placements_.at(n_slices)) {
+        if (placements.size() == n_instances) {
+            break;
+        }
+        if ((occupied & mask(placement)) == 0) {
+            placements.push_back(placement);
+            occupied |= mask(placement);
+        }
+    }
+    return placements.size() == n_instances;
+}
+
+void Scheduler::erase(std::uint64_t id) {
+    auto it = bookings_.find(id);
+    for (auto lease : it->second.leases) {
+        lease_bookings_.erase(lease);
+    }
+    calendar_.erase(it->second.start, id);
+    bookings_.erase(it);
+}
+
+void Scheduler::prune(clock::time_point now) {
+    std::vector<std::uint64_t> ended;
+    calendar_.overlapping(clock::time_point::min(), now,
+                          [&](clock::time_point, clock::time_point end,
+                              std::uint64_t id) {
+                              if (end <= now) {
+                                  ended.push_back(id);
+                              }
+                          });
+    for (auto id : ended) {
+        // the lease may not have been reaped yet
+        for (auto lease : bookings_.at(id).leases) {
+            Lease expired;
+            expired.id = lease;
+            allocator_.release(expired);
+        }
+        erase(id);
+    }
+}
+
+std::uint64_t Scheduler::reserve(unsigned short n_instances,
+                                 unsigned short n_slices,
+                                 clock::time_point start,
+                                 clock::duration duration) {
+    if (placements_.count(n_slices) == 0) {
+        throw std::invalid_argument("n_slices is out of range");
+    }
+    if (n_instances == 0 || duration <= clock::duration::zero()) {
+        throw std::invalid_argument("reservation is empty");
+    }
+    const clock::time_point end = start + duration;
+    std::unique_lock<std::mutex> lock(mutex_);
+    prune(clock::now());
+    std::vector<nvmlGpuInstancePlacement_t> placements;
+    if (!place(start, end, n_slices, n_instances, placements)) {
+        throw std::runtime_error("reservation conflicts with the calendar");
+    }
+    const std::uint64_t id = next_booking_id_++;
+    bookings_[id] = Booking{start, end, n_slices, placements, false, {}};
+    calendar_.insert(start, end, id);
+    return id;
+}
+
+std::vector<Lease> Scheduler::claim(std::uint64_t reservation) {
+    clock::time_point start;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = bookings_.find(reservation);
+        if (it == bookings_.end() || it->second.claimed) {
+            throw std::invalid_argument("reservation cannot be claimed");
+        }
+        start = it->second.start;
+    }
+    std::this_thread::sleep_until(start);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto now = clock::now();
+    prune(now);
+    auto it = bookings_.find(reservation);
+    if (it == bookings_.end()) {
+        throw std::runtime_error("reservation has ended or was cancelled");
+    }
+    Booking &booking = it->second;
+    if (booking.claimed) {
+        throw std::invalid_argument("reservation cannot be claimed");
+    }
+    const auto ttl =
+        std::chrono::duration_cast<std::chrono::milliseconds>(booking.end -
+                                                              now);
+    std::vector<Lease> ret;
+    try {
+        for (const auto &placement : booking.placements) {
+            ret.push_back(allocator_.lease(
+                allocator_.allocate(booking.n_slices, placement), ttl,
+                booking.end));
+        }
+    } catch (...) {
+        for (const auto &lease : ret) {
+            allocator_.release(lease);
+        }
+        throw;
+    }
+    booking.claimed = true;
+    for (const auto &lease : ret) {
+        booking.leases.push_back(lease.id);
+        lease_bookings_[lease.id] = reservation;
+    }
+    return ret;
+}
+
+bool Scheduler::cancel(std::uint64_t reservation) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = bookings_.find(reservation);
+    if (it == bookings_.end()) {
+        return false;
+    }
+    for (auto lease : it->second.leases) {
+        Lease claimed;
+        claimed.id = lease;
+        allocator_.release(claimed);
+    }
+    erase(reservation);
+    return true;
+}
+
+Lease Scheduler::backfill(unsigned short n_slices, clock::duration hold) {
+    if (hold <= clock::duration::zero()) {
+        throw std::invalid_argument("hold is not positive");
+    }
+    return backfill(n_slices, clock::now() + hold);
+}
+
+Lease Scheduler::backfill(unsigned short n_slices, clock::time_point until) {
+    if (placements_.count(n_slices) == 0) {
+        throw std::invalid_argument("n_slices is out of range");
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto now = clock::now();
+    const auto end = until;
+    if (end <= now) {
+        throw std::invalid_argument("until is not after now");
+    }
+    prune(now);
+    std::vector<nvmlGpuInstancePlacement_t> placements;
+    if (!place(now, end, n_slices, 1, placements)) {
+        throw std::runtime_error("backfill conflicts with the calendar");
+    }
+    Lease lease = allocator_.lease(
+        allocator_.allocate(n_slices, placements.front()),
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - now),
+        end);
+    const std::uint64_t id = next_booking_id_++;
+    bookings_[id] = Booking{now, end, n_slices, placements, true, {lease.id}};
+    calendar_.insert(now, end, id);
+    lease_bookings_[lease.id] = id;
+    return lease;
+}
+
+bool Scheduler::release(const Lease &lease) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = lease_bookings_.find(lease.id);
+    if (it == lease_bookings_.end()) {
+        return false;
+    }
+    const std::uint64_t id = it->second;
+    lease_bookings_.erase(it);
+    const bool released = allocator_.release(lease);
+    Booking &booking = bookings_.at(id);
+    const auto index =
+        std::find(booking.leases.begin(), booking.leases.end(), lease.id) -
+        booking.leases.begin();
+    booking.leases.erase(booking.leases.begin() + index);
+    booking.placements.erase(booking.placements.begin() + index);
+    if (booking.placements.empty()) {
+        erase(id);
+    }
+    return released;
+}
+
+}  // namespace nvml
@@ -14,6 +14,11 @@ SharedGIAllocator::SharedGIAllocator(GPU &device)
     : Allocator(device), gpu_instance_(device_, A100_N_SLICES) {
 }
 
+SharedGIAllocator::~SharedGIAllocator() noexcept {
+    // leased Compute Instances must be destroyed before gpu_instance_
+    release_leases();
+}
+
 unsigned int
 SharedGIAllocator::remaining(unsigned short n_slices) const noexcept {
     return gpu_instance_.remaining_compute_instance_capacity(n_slices);
@@ -26,11 +31,35 @@ ComputeInstance SharedGIAllocator::allocate(unsigned short n_slices) {
     }
     std::unique_lock<std::mutex> lock(mutex_);
     ComputeInstance compute_instance(gpu_instance_, n_slices);
+    track(compute_instance);
     return compute_instance;
 }
 
+ComputeInstance SharedGIAllocator::allocate(const Request &request) {
+    // memory and engines belong to the shared GPU Instance, so only the
+    // multiprocessors are sized per Compute Instance
+    const unsigned int multiprocessors = required_multiprocessors(request);
+    if (!fits(gpu_instance_.get_profile(), request, multiprocessors)) {
+        throw std::invalid_argument(
+            "request does not fit the shared GPU Instance");
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto &profile :
+         fitting_compute_instance_profiles(gpu_instance_, multiprocessors)) {
+        if (gpu_instance_.remaining_compute_instance_capacity(profile) == 0) {
+            // fall back to the next larger profile
+            continue;
+        }
+        ComputeInstance compute_instance(gpu_instance_, profile);
+        track(compute_instance);
+        return compute_instance;
+    }
+    throw std::runtime_error("No Compute Instance capacity for request");
+}
+
 void SharedGIAllocator::free(ComputeInstance &&instance) {
     std::unique_lock<std::mutex> lock(mutex_);
+    untrack(instance);
     { ComputeInstance free_on_scope_exit = std::move(instance); }
     cv_.notify_all();
 }
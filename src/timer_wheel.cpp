@@ -0,0 +1,62 @@
+#include "nvml_control/timer_wheel.hpp"
+
+namespace nvml {
+
+constexpr unsigned int TimerWheel::LEVELS;
+constexpr unsigned int TimerWheel::SLOT_BITS;
+constexpr unsigned int TimerWheel::SLOTS;
+constexpr std::uint64_t TimerWheel::MAX_DELAY;
+
+void TimerWheel::schedule(std::uint64_t id, std::uint64_t expires) {
+    if (expires <= now_) {
+        expires = now_ + 1;
+    } else if (expires - now_ > MAX_DELAY) {
+        expires = now_ + MAX_DELAY;
+    }
+    insert({id, expires});
+    size_++;
+}
+
+void TimerWheel::insert(const Timer &timer) {
+    // the innermost level whose range covers the delay
+    const std::uint64_t delay = timer.expires - now_;
+    unsigned int level = 0;
+    while (level < LEVELS - 1 && (delay >> (SLOT_BITS * (level + 1))) != 0) {
+        level++;
+    }
+    const unsigned int slot =
+        (timer.expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+    slots_[level][slot].push_back(timer);
+}
+
+void TimerWheel::advance(std::uint64_t tick,
+                         std::vector<std::uint64_t> &expired) {
+    std::vector<Timer> due;
+    while (now_ < tick) {
+        now_++;
+        // cascade outer levels first so that their timers can continue
+        // inward on this same tick
+        for (unsigned int level = LEVELS - 1; level > 0; level--) {
+            const std::uint64_t mask =
+                (std::uint64_t{1} << (SLOT_BITS * level)) - 1;
+            if ((now_ & mask) != 0) {
+                continue;
+            }
+            const unsigned int slot =
+                (now_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+            due.clear();
+            due.swap(slots_[level][slot]);
+            for (const auto &timer : due) {
+                insert(timer);
+            }
+        }
+        auto &slot = slots_[0][now_ & (SLOTS - 1)];
+        for (const auto &timer : slot) {
+            expired.push_back(timer.id);
+        }
+        size_ -= slot.size();
+        slot.clear();
+    }
+}
+
+}  // namespace nvml
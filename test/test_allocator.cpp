@@ -2,6 +2,7 @@
 #include "nvml_control/allocator.hpp"
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <chrono>
 #include <list>
 #include <thread>
@@ -11,6 +12,7 @@ namespace mut = nvml;
 namespace {
 // hard-coded for an A100 GPU
 constexpr int TEST_GPU_ID = 1;
+constexpr unsigned int A100_N_SLICES = 7;
 }  // anonymous namespace
 
 template <typename AllocatorType>
@@ -139,3 +141,152 @@ TYPED_TEST(Allocator, DifferentCudaVisibleDevicesStrings) {
     ASSERT_NE(this->allocated_.front().get_cuda_visible_devices_string(),
               this->allocated_.back().get_cuda_visible_devices_string());
 }
+
+TYPED_TEST(Allocator, AllocateRequest_Smallest) {
+    mut::Request request;
+    request.sm_fraction = 0.1;
+    this->allocated_.push_back(this->allocator_.allocate(request));
+    const auto &shape = this->allocated_.back().get_shape();
+    EXPECT_EQ(1u, shape.compute_instance_slices);
+    EXPECT_GE(shape.multiprocessor_count,
+              0.1 * this->gpu_.multiprocessor_count());
+}
+
+TYPED_TEST(Allocator, AllocateRequest_MemoryBound) {
+    unsigned long long min_memory_mb = ~0ull;
+    for (const auto &profile : this->gpu_.gpu_instance_profiles()) {
+        min_memory_mb = std::min(min_memory_mb, profile.memorySizeMB);
+    }
+    mut::Request request;
+    request.memory_mb = min_memory_mb + 1;
+    this->allocated_.push_back(this->allocator_.allocate(request));
+    const auto &shape = this->allocated_.back().get_shape();
+    EXPECT_GE(shape.memory_mb, request.memory_mb);
+    // a memory-bound request does not need more than one slice of compute
+    EXPECT_EQ(1u, shape.compute_instance_slices);
+}
+
+TYPED_TEST(Allocator, AllocateRequest_Invalid) {
+    mut::Request request;
+    request.sm_fraction = 1.5;
+    EXPECT_THROW(this->allocator_.allocate(request), std::invalid_argument);
+    request.sm_fraction = 0.0;
+    request.memory_mb = ~0ull;
+    EXPECT_THROW(this->allocator_.allocate(request), std::invalid_argument);
+}
+
+TYPED_TEST(Allocator, Sampler_SamplesLiveInstances) {
+    this->allocated_.push_back(this->allocator_.allocate(1));
+    this->allocator_.start_sampler(std::chrono::milliseconds(10));
+    this->allocated_.push_back(this->allocator_.allocate(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const mut::Sampler *sampler = this->allocator_.sampler();
+    ASSERT_NE(nullptr, sampler);
+    for (const auto &instance : this->allocated_) {
+        auto samples = sampler->recent(instance);
+        ASSERT_FALSE(samples.empty());
+        EXPECT_GT(samples.back().memory_total, 0u);
+        EXPECT_EQ(0u, samples.back().process_count);
+        // the sampler keeps running, so the aggregate is bracketed by two
+        // snapshots; the window covers the whole test
+        auto utilization =
+            sampler->aggregate(instance, std::chrono::seconds(1));
+        EXPECT_LE(samples.size(), utilization.n_samples);
+        EXPECT_GE(sampler->recent(instance).size(), utilization.n_samples);
+        EXPECT_EQ(0.0, utilization.active_fraction);
+    }
+    this->allocator_.stop_sampler();
+    EXPECT_EQ(nullptr, this->allocator_.sampler());
+}
+
+TYPED_TEST(Allocator, Lease_ExpiresWithoutHeartbeat) {
+    constexpr unsigned int n_slices = 1;
+    auto total = this->allocator_.remaining(n_slices);
+    for (unsigned int i = 0; i < total - 1; i++) {
+        this->allocated_.push_back(this->allocator_.allocate(n_slices));
+    }
+    auto lease = this->allocator_.lease(this->allocator_.allocate(n_slices),
+                                        std::chrono::milliseconds(50));
+    EXPECT_FALSE(lease.cuda_visible_devices.empty());
+    EXPECT_THROW(this->allocator_.allocate(n_slices), std::runtime_error);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(this->allocator_.heartbeat(lease));
+    EXPECT_FALSE(this->allocator_.release(lease));
+    this->allocated_.push_back(this->allocator_.allocate(n_slices));
+}
+
+TYPED_TEST(Allocator, Lease_HeartbeatKeepsAlive) {
+    auto lease = this->allocator_.lease(this->allocator_.allocate(1),
+                                        std::chrono::milliseconds(100));
+    for (int i = 0; i < 10; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        ASSERT_TRUE(this->allocator_.heartbeat(lease));
+    }
+    EXPECT_TRUE(this->allocator_.release(lease));
+    EXPECT_FALSE(this->allocator_.release(lease));
+}
+
+TYPED_TEST(Allocator, Lease_ExpiryWakesAllocateFor) {
+    constexpr unsigned int n_slices = 1;
+    auto total = this->allocator_.remaining(n_slices);
+    for (unsigned int i = 0; i < total - 1; i++) {
+        this->allocated_.push_back(this->allocator_.allocate(n_slices));
+    }
+    this->allocator_.lease(this->allocator_.allocate(n_slices),
+                           std::chrono::milliseconds(50));
+    EXPECT_THROW(
+        this->allocator_.allocate_for(n_slices, std::chrono::milliseconds(10)),
+        std::runtime_error);
+    this->allocated_.push_back(
+        this->allocator_.allocate_for(n_slices, std::chrono::seconds(5)));
+}
+
+TYPED_TEST(Allocator, Lease_NotAfterInThePastExpires) {
+    // not_after precedes the reaper's epoch
+    const std::chrono::steady_clock::time_point not_after{};
+    auto lease = this->allocator_.lease(this->allocator_.allocate(1),
+                                        std::chrono::seconds(10), not_after);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(this->allocator_.heartbeat(lease));
+}
+
+TEST(GangAllocator, AllocateFree) {
+    mut::GPU gpu(TEST_GPU_ID);
+    mut::IsolatedGIAllocator allocator(gpu);
+    mut::GangAllocator gang({&allocator});
+    auto instances = gang.allocate(1, 3);
+    ASSERT_EQ(1u, instances.size());
+    EXPECT_EQ(TEST_GPU_ID, instances.front().get_device_id());
+    EXPECT_THROW(gang.allocate(2, 1), std::invalid_argument);
+    gang.free(std::move(instances));
+    EXPECT_EQ(A100_N_SLICES, allocator.remaining(1));
+}
+
+TEST(GangAllocator, OneInstancePerGPU) {
+    mut::GPU gpu(TEST_GPU_ID);
+    mut::IsolatedGIAllocator first(gpu);
+    mut::IsolatedGIAllocator second(gpu);
+    mut::GangAllocator gang({&first, &second});
+    // both allocators are on the same GPU
+    EXPECT_THROW(gang.allocate(2, 1), std::invalid_argument);
+    auto instances = gang.allocate(1, 1);
+    ASSERT_EQ(1u, instances.size());
+    gang.free(std::move(instances));
+    EXPECT_EQ(A100_N_SLICES, first.remaining(1));
+}
+
+TEST(GangAllocator, FreeForeignInstanceThrows) {
+    mut::GPU gpu(TEST_GPU_ID);
+    mut::IsolatedGIAllocator allocator(gpu);
+    mut::GangAllocator gang({&allocator});
+    auto instances = gang.allocate(1, 1);
+    instances.push_back(allocator.allocate(1));
+    EXPECT_THROW(gang.free(std::move(instances)), std::invalid_argument);
+    // nothing was freed, so both instances can still be freed by their owners
+    ASSERT_EQ(2u, instances.size());
+    EXPECT_TRUE(instances.front().is_valid());
+    allocator.free(std::move(instances.back()));
+    instances.pop_back();
+    gang.free(std::move(instances));
+    EXPECT_EQ(A100_N_SLICES, allocator.remaining(1));
+}
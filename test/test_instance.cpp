@@ -2,6 +2,7 @@
 #include "gtest/gtest.h"
 
 #include <algorithm>
+#include <memory>
 
 namespace mut = nvml;
 
@@ -15,6 +16,45 @@ TEST(NvmlControl, GPU_ConstructDestruct) {
     mut::GPU gpu(TEST_GPU_ID);
 }
 
+TEST(NvmlControl, GPU_InvalidIndexThrows) {
+    EXPECT_THROW(mut::GPU gpu(-1), std::runtime_error);
+    EXPECT_THROW(mut::GPU gpu(1 << 16), std::runtime_error);
+}
+
+TEST(NvmlControl, ReferenceCounted) {
+    mut::GPU gpu(TEST_GPU_ID);
+    {
+        // releasing other references must not shut NVML down under gpu
+        mut::NVMLControl nvml;
+        mut::GPU copy(gpu);
+    }
+    EXPECT_EQ(A100_N_SLICES, gpu.remaining_gpu_instance_capacity(1));
+}
+
+TEST(NvmlControl, ReinitializedAfterLastReference) {
+    { mut::GPU gpu(TEST_GPU_ID); }
+    mut::GPU gpu(TEST_GPU_ID);
+    EXPECT_EQ(A100_N_SLICES, gpu.remaining_gpu_instance_capacity(1));
+}
+
+TEST(NvmlControl, InstanceOutlivesGPU) {
+    // the instances must keep NVML initialized after the GPU is destroyed
+    std::unique_ptr<mut::GPU> gpu(new mut::GPU(TEST_GPU_ID));
+    mut::GPUInstance shared(*gpu, 4);
+    mut::ComputeInstance compute_instance(shared, 1);
+    mut::ComputeInstance managed(mut::GPUInstance(*gpu, 1), 1);
+    const int numa_node = gpu->numa_node();
+    const cpu_set_t cpu_affinity = gpu->cpu_affinity();
+    gpu.reset();
+    EXPECT_TRUE(compute_instance.is_valid());
+    EXPECT_TRUE(managed.is_valid());
+    // the GPU's properties were copied into the instance
+    EXPECT_EQ(TEST_GPU_ID, managed.get_device_id());
+    EXPECT_EQ(numa_node, managed.get_numa_node());
+    const cpu_set_t instance_affinity = managed.get_cpu_affinity();
+    EXPECT_TRUE(CPU_EQUAL(&cpu_affinity, &instance_affinity));
+}
+
 class NvmlControlGPU : public ::testing::Test {
 public:
     mut::GPU gpu_;
@@ -90,3 +130,17 @@ TEST_F(NvmlControlGPUInstance,
     ASSERT_NE(ci1.get_cuda_visible_devices_string(),
               ci2.get_cuda_visible_devices_string());
 }
+
+TEST_F(NvmlControlGPU, CpuAffinity) {
+    EXPECT_GT(CPU_COUNT(&gpu_.cpu_affinity()), 0);
+    EXPECT_GE(gpu_.numa_node(), -1);
+    EXPECT_EQ(0u, gpu_.distance(gpu_));
+}
+
+TEST_F(NvmlControlGPUInstance, ComputeInstance_CpuAffinity) {
+    mut::ComputeInstance ci(gpu_instance_, 1);
+    auto cpus = ci.get_cpu_affinity();
+    EXPECT_TRUE(CPU_EQUAL(&cpus, &gpu_.cpu_affinity()));
+    EXPECT_EQ(gpu_.numa_node(), ci.get_numa_node());
+    EXPECT_EQ(TEST_GPU_ID, ci.get_device_id());
+}
@@ -0,0 +1,85 @@
+#include "nvml_control/interval_tree.hpp"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace mut = nvml;
+
+namespace {
+using Interval = std::tuple<int, int, int>;  // start, end, value
+
+std::vector<Interval> overlapping(const mut::IntervalTree<int, int> &tree,
+                                  int start, int end) {
+    std::vector<Interval> ret;
+    tree.overlapping(start, end, [&](int s, int e, int v) {
+        ret.emplace_back(s, e, v);
+    });
+    return ret;
+}
+}  // anonymous namespace
+
+TEST(IntervalTree, Overlapping) {
+    mut::IntervalTree<int, int> tree;
+    tree.insert(0, 10, 1);
+    tree.insert(5, 15, 2);
+    tree.insert(20, 30, 3);
+    EXPECT_EQ(3u, tree.size());
+    EXPECT_EQ(std::vector<Interval>({Interval{0, 10, 1}, Interval{5, 15, 2}}),
+              overlapping(tree, 8, 12));
+    // intervals are half-open
+    EXPECT_EQ(std::vector<Interval>({Interval{5, 15, 2}}),
+              overlapping(tree, 10, 20));
+    EXPECT_TRUE(overlapping(tree, 15, 20).empty());
+    EXPECT_EQ(std::vector<Interval>({Interval{20, 30, 3}}),
+              overlapping(tree, 29, 100));
+}
+
+TEST(IntervalTree, Erase) {
+    mut::IntervalTree<int, int> tree;
+    tree.insert(0, 10, 1);
+    tree.insert(0, 20, 2);
+    EXPECT_FALSE(tree.erase(0, 3));
+    EXPECT_TRUE(tree.erase(0, 1));
+    EXPECT_FALSE(tree.erase(0, 1));
+    EXPECT_EQ(std::vector<Interval>({Interval{0, 20, 2}}),
+              overlapping(tree, 0, 5));
+    EXPECT_TRUE(tree.erase(0, 2));
+    EXPECT_TRUE(tree.empty());
+}
+
+TEST(IntervalTree, MatchesBruteForce) {
+    mut::IntervalTree<int, int> tree;
+    std::set<Interval> intervals;
+    std::mt19937 random(7);
+    for (int value = 0; value < 2000; value++) {
+        int start = random() % 10000;
+        int end = start + 1 + random() % 500;
+        tree.insert(start, end, value);
+        intervals.emplace(start, end, value);
+        if (value % 3 == 0) {
+            // erase a random existing interval
+            auto it = intervals.begin();
+            std::advance(it, random() % intervals.size());
+            ASSERT_TRUE(tree.erase(std::get<0>(*it), std::get<2>(*it)));
+            intervals.erase(it);
+        }
+    }
+    ASSERT_EQ(intervals.size(), tree.size());
+    for (int query = 0; query < 200; query++) {
+        int start = random() % 10000;
+        int end = start + 1 + random() % 1000;
+        std::multiset<Interval> expected, actual;
+        for (const auto &interval : intervals) {
+            if (std::get<0>(interval) < end && start < std::get<1>(interval)) {
+                expected.insert(interval);
+            }
+        }
+        for (const auto &interval : overlapping(tree, start, end)) {
+            actual.insert(interval);
+        }
+        ASSERT_EQ(expected, actual);
+    }
+}
@@ -0,0 +1,108 @@
+#include "nvml_control/launcher.hpp"
+#include "gtest/gtest.h"
+
+#include <csignal>
+#include <list>
+#include <sys/wait.h>
+#include <thread>
+
+namespace mut = nvml;
+
+namespace {
+// hard-coded for an A100 GPU
+constexpr int TEST_GPU_ID = 1;
+
+/// Ignores SIGCHLD, so that the kernel reaps children itself, until scope exit
+class IgnoreSigchld {
+    void (*previous_)(int);
+
+public:
+    IgnoreSigchld() : previous_(signal(SIGCHLD, SIG_IGN)) {}
+    ~IgnoreSigchld() { signal(SIGCHLD, previous_); }
+};
+}  // anonymous namespace
+
+class Launcher : public ::testing::Test {
+public:
+    mut::GPU gpu_;
+    mut::IsolatedGIAllocator allocator_;
+    Launcher() : gpu_(TEST_GPU_ID), allocator_(gpu_) {}
+};
+
+TEST_F(Launcher, SetsCudaVisibleDevices) {
+    mut::Launcher launcher(allocator_);
+    auto job = launcher.launch(
+        1, {"sh", "-c",
+            "case \"$CUDA_VISIBLE_DEVICES\" in MIG-*) exit 0;; esac; exit 1"});
+    EXPECT_FALSE(job.cuda_visible_devices.empty());
+    int status = launcher.wait(job);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    EXPECT_GE(job.allocate_to_exec_latency, job.allocate_latency);
+}
+
+TEST_F(Launcher, FreesOnExit) {
+    constexpr unsigned int n_slices = 1;
+    const auto total = allocator_.remaining(n_slices);
+    mut::Launcher launcher(allocator_);
+    std::list<mut::Job> jobs;
+    for (unsigned int i = 0; i < total; i++) {
+        jobs.push_back(launcher.launch(n_slices, {"sleep", "0.1"}));
+    }
+    EXPECT_EQ(0u, allocator_.remaining(n_slices));
+    EXPECT_EQ(total, launcher.running());
+    for (const auto &job : jobs) {
+        EXPECT_EQ(0, launcher.wait(job));
+    }
+    EXPECT_EQ(total, allocator_.remaining(n_slices));
+    EXPECT_EQ(0u, launcher.running());
+}
+
+TEST_F(Launcher, SpawnFailureFrees) {
+    constexpr unsigned int n_slices = 1;
+    const auto total = allocator_.remaining(n_slices);
+    mut::Launcher launcher(allocator_);
+    EXPECT_THROW(launcher.launch(n_slices, {"/nonexistent/command"}),
+                 std::system_error);
+    EXPECT_EQ(total, allocator_.remaining(n_slices));
+}
+
+TEST_F(Launcher, EmptyArgvDoesNotAllocate) {
+    constexpr unsigned int n_slices = 1;
+    const auto total = allocator_.remaining(n_slices);
+    mut::Launcher launcher(allocator_);
+    EXPECT_THROW(launcher.launch(n_slices, {}), std::invalid_argument);
+    EXPECT_EQ(total, allocator_.remaining(n_slices));
+}
+
+TEST_F(Launcher, ChildReapedElsewhere) {
+    constexpr unsigned int n_slices = 1;
+    const auto total = allocator_.remaining(n_slices);
+    IgnoreSigchld ignore;
+    mut::Launcher launcher(allocator_);
+    // fast children exit before the launch returns
+    for (int i = 0; i < 20; i++) {
+        auto job = launcher.launch(n_slices, {"true"});
+        EXPECT_EQ(mut::Launcher::UNKNOWN_STATUS, launcher.wait(job));
+        EXPECT_EQ(total, allocator_.remaining(n_slices));
+    }
+}
+
+TEST_F(Launcher, Detach) {
+    constexpr unsigned int n_slices = 1;
+    const auto total = allocator_.remaining(n_slices);
+    mut::Launcher launcher(allocator_);
+    auto running = launcher.launch(n_slices, {"sleep", "0.1"});
+    auto exited = launcher.launch(n_slices, {"true"});
+    EXPECT_NE(running.id, exited.id);
+    EXPECT_EQ(0, launcher.wait(launcher.launch(n_slices, {"true"})));
+    EXPECT_TRUE(launcher.detach(running));
+    EXPECT_FALSE(launcher.detach(running));
+    EXPECT_THROW(launcher.wait(running), std::invalid_argument);
+    while (launcher.running() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(launcher.detach(exited));
+    EXPECT_THROW(launcher.wait(exited), std::invalid_argument);
+    EXPECT_EQ(total, allocator_.remaining(n_slices));
+}
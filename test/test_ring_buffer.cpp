@@ -0,0 +1,71 @@
+#include "nvml_control/ring_buffer.hpp"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+namespace mut = nvml;
+
+TEST(RingBuffer, Empty) {
+    mut::RingBuffer<int, 4> ring;
+    EXPECT_TRUE(ring.recent().empty());
+    EXPECT_EQ(0u, ring.size());
+}
+
+TEST(RingBuffer, RecentOldestFirst) {
+    mut::RingBuffer<int, 4> ring;
+    ring.push(1);
+    ring.push(2);
+    ring.push(3);
+    EXPECT_EQ(std::vector<int>({1, 2, 3}), ring.recent());
+    EXPECT_EQ(std::vector<int>({2, 3}), ring.recent(2));
+}
+
+TEST(RingBuffer, OverwritesOldest) {
+    mut::RingBuffer<int, 4> ring;
+    for (int i = 0; i < 10; i++) {
+        ring.push(i);
+    }
+    EXPECT_EQ(std::vector<int>({6, 7, 8, 9}), ring.recent());
+    EXPECT_EQ(10u, ring.size());
+}
+
+namespace {
+struct Pair {
+    unsigned long long first;
+    unsigned long long second;
+    unsigned int third;
+};
+}  // namespace
+
+TEST(RingBuffer, ConcurrentReadersSeeConsistentValues) {
+    mut::RingBuffer<Pair, 16> ring;
+    std::atomic<bool> done{false};
+    std::thread producer([&] {
+        for (unsigned long long i = 0; i < 200000; i++) {
+            ring.push({i, ~i, static_cast<unsigned int>(i)});
+        }
+        done = true;
+    });
+    // count failures instead of asserting so that producer is always joined
+    std::size_t torn{0}, out_of_order{0};
+    while (!done) {
+        unsigned long long last = 0;
+        bool first = true;
+        for (const auto &value : ring.recent()) {
+            // a torn read would break the relationship between the fields
+            if (~value.first != value.second ||
+                static_cast<unsigned int>(value.first) != value.third) {
+                torn++;
+            }
+            if (!first && last >= value.first) {
+                out_of_order++;
+            }
+            last = value.first;
+            first = false;
+        }
+    }
+    producer.join();
+    EXPECT_EQ(0u, torn);
+    EXPECT_EQ(0u, out_of_order);
+}
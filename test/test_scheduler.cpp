@@ -0,0 +1,112 @@
+#include "nvml_control/scheduler.hpp"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+
+namespace mut = nvml;
+
+namespace {
+// hard-coded for an A100 GPU
+constexpr int TEST_GPU_ID = 1;
+constexpr unsigned int A100_N_SLICES = 7;
+}  // anonymous namespace
+
+class Scheduler : public ::testing::Test {
+public:
+    using clock = mut::Scheduler::clock;
+    mut::GPU gpu_;
+    mut::IsolatedGIAllocator allocator_;
+    mut::Scheduler scheduler_;
+    Scheduler() : gpu_(TEST_GPU_ID), allocator_(gpu_), scheduler_(allocator_) {}
+};
+
+TEST_F(Scheduler, ReserveRejectsConflicts) {
+    const auto start = clock::now() + std::chrono::seconds(10);
+    scheduler_.reserve(1, A100_N_SLICES, start, std::chrono::seconds(1));
+    EXPECT_THROW(scheduler_.reserve(1, 1,
+                                    start + std::chrono::milliseconds(500),
+                                    std::chrono::seconds(1)),
+                 std::runtime_error);
+    // windows are half-open, so a reservation may start as another ends
+    scheduler_.reserve(7, 1, start + std::chrono::seconds(1),
+                       std::chrono::seconds(1));
+    EXPECT_THROW(scheduler_.reserve(1, 5, start, std::chrono::seconds(1)),
+                 std::invalid_argument);
+}
+
+TEST_F(Scheduler, ReserveChecksPlacements) {
+    const auto start = clock::now() + std::chrono::seconds(10);
+    // two 3-slice instances leave no placement for a third slice
+    scheduler_.reserve(2, 3, start, std::chrono::seconds(1));
+    EXPECT_THROW(scheduler_.reserve(1, 1, start, std::chrono::seconds(1)),
+                 std::runtime_error);
+}
+
+TEST_F(Scheduler, ClaimUsesBookedPlacements) {
+    const auto start = clock::now() + std::chrono::milliseconds(50);
+    auto small = scheduler_.reserve(1, 1, start, std::chrono::seconds(1));
+    // the only 4-slice placement starts at the first slice, so the 1-slice
+    // instance must not be created there
+    auto large = scheduler_.reserve(1, 4, start + std::chrono::milliseconds(50),
+                                    std::chrono::seconds(1));
+    auto small_leases = scheduler_.claim(small);
+    auto large_leases = scheduler_.claim(large);
+    ASSERT_EQ(1u, large_leases.size());
+    EXPECT_EQ(4u, large_leases.front().shape.gpu_instance_slices);
+    EXPECT_TRUE(scheduler_.release(small_leases.front()));
+    EXPECT_TRUE(scheduler_.release(large_leases.front()));
+    EXPECT_EQ(A100_N_SLICES, allocator_.remaining(1));
+}
+
+TEST_F(Scheduler, BackfillBeforeReservation) {
+    const auto start = clock::now() + std::chrono::milliseconds(200);
+    auto reservation = scheduler_.reserve(1, A100_N_SLICES, start,
+                                          std::chrono::seconds(1));
+    auto short_job = scheduler_.backfill(1, std::chrono::milliseconds(50));
+    // would still hold its slice when the reservation starts
+    EXPECT_THROW(scheduler_.backfill(1, std::chrono::seconds(1)),
+                 std::runtime_error);
+    EXPECT_TRUE(scheduler_.release(short_job));
+    EXPECT_FALSE(scheduler_.release(short_job));
+
+    scheduler_.backfill(1, std::chrono::milliseconds(50));
+    // the backfill is not released; claim reclaims it once its hold ends
+    auto leases = scheduler_.claim(reservation);
+    ASSERT_EQ(1u, leases.size());
+    EXPECT_EQ(A100_N_SLICES, leases.front().shape.gpu_instance_slices);
+    EXPECT_TRUE(scheduler_.release(leases.front()));
+    EXPECT_EQ(A100_N_SLICES, allocator_.remaining(1));
+}
+
+TEST_F(Scheduler, BackfillEndingAtReservation) {
+    // the reaper may still be freeing the backfill when the claim starts
+    for (int i = 0; i < 10; i++) {
+        const auto start = clock::now() + std::chrono::milliseconds(50);
+        auto reservation = scheduler_.reserve(1, A100_N_SLICES, start,
+                                              std::chrono::seconds(1));
+        scheduler_.backfill(A100_N_SLICES, start);
+        auto leases = scheduler_.claim(reservation);
+        ASSERT_EQ(1u, leases.size());
+        EXPECT_TRUE(scheduler_.release(leases.front()));
+    }
+    EXPECT_EQ(A100_N_SLICES, allocator_.remaining(1));
+}
+
+TEST_F(Scheduler, BackfillRejectsEmptyHold) {
+    EXPECT_THROW(scheduler_.backfill(1, clock::duration::zero()),
+                 std::invalid_argument);
+    EXPECT_THROW(scheduler_.backfill(1, -std::chrono::seconds(1)),
+                 std::invalid_argument);
+    EXPECT_THROW(scheduler_.backfill(1, clock::now()), std::invalid_argument);
+    EXPECT_EQ(A100_N_SLICES, allocator_.remaining(1));
+}
+
+TEST_F(Scheduler, Cancel) {
+    const auto start = clock::now() + std::chrono::seconds(10);
+    auto reservation = scheduler_.reserve(1, A100_N_SLICES, start,
+                                          std::chrono::seconds(1));
+    EXPECT_TRUE(scheduler_.cancel(reservation));
+    EXPECT_FALSE(scheduler_.cancel(reservation));
+    scheduler_.reserve(1, A100_N_SLICES, start, std::chrono::seconds(1));
+}
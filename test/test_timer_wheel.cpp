@@ -0,0 +1,71 @@
+#include "nvml_control/timer_wheel.hpp"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace mut = nvml;
+
+TEST(TimerWheel, ExpiresOnTick) {
+    mut::TimerWheel wheel;
+    std::vector<std::uint64_t> expired;
+    wheel.schedule(1, 5);
+    wheel.advance(4, expired);
+    EXPECT_TRUE(expired.empty());
+    wheel.advance(5, expired);
+    EXPECT_EQ(std::vector<std::uint64_t>({1}), expired);
+    EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheel, PastTimersExpireOnNextTick) {
+    mut::TimerWheel wheel;
+    std::vector<std::uint64_t> expired;
+    wheel.advance(10, expired);
+    wheel.schedule(1, 3);
+    wheel.advance(11, expired);
+    EXPECT_EQ(std::vector<std::uint64_t>({1}), expired);
+}
+
+TEST(TimerWheel, ClampsToMaxDelay) {
+    mut::TimerWheel wheel;
+    std::vector<std::uint64_t> expired;
+    wheel.schedule(1, ~std::uint64_t{0});
+    wheel.advance(mut::TimerWheel::MAX_DELAY - 1, expired);
+    EXPECT_TRUE(expired.empty());
+    wheel.advance(mut::TimerWheel::MAX_DELAY, expired);
+    EXPECT_EQ(std::vector<std::uint64_t>({1}), expired);
+}
+
+TEST(TimerWheel, CascadesAcrossLevels) {
+    // every timer must expire exactly on its tick, including those that
+    // cascade through several levels
+    mut::TimerWheel wheel;
+    std::mt19937_64 random(42);
+    std::map<std::uint64_t, std::uint64_t> expires;
+    std::vector<std::uint64_t> expired;
+    const std::uint64_t horizon = 300000;
+    for (std::uint64_t id = 0; id < 10000; id++) {
+        expires[id] = 1 + random() % horizon;
+        wheel.schedule(id, expires[id]);
+    }
+    // schedule more timers part way through
+    wheel.advance(4095, expired);
+    for (std::uint64_t id = 10000; id < 12000; id++) {
+        expires[id] = wheel.now() + 1 + random() % horizon;
+        wheel.schedule(id, expires[id]);
+    }
+    std::size_t n_expired = expired.size();
+    for (auto id : expired) {
+        ASSERT_GE(wheel.now(), expires[id]);
+    }
+    while (wheel.size() > 0) {
+        expired.clear();
+        wheel.advance(wheel.now() + 1, expired);
+        for (auto id : expired) {
+            ASSERT_EQ(wheel.now(), expires[id]) << "timer " << id;
+        }
+        n_expired += expired.size();
+    }
+    EXPECT_EQ(expires.size(), n_expired);
+}